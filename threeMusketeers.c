@@ -11,579 +11,7359 @@
  * @bug No known bugs.
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#define N 5
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// The variant is fixed at compile time, for example gcc -DN=6 -DMUSKETEERS=4 -DWIN_LINE=3.
+#ifndef N
+#define N 5                                           // Rows and collumns of the board.
+#endif
+#ifndef MUSKETEERS
+#define MUSKETEERS 3
+#endif
+#ifndef WIN_LINE
+#define WIN_LINE MUSKETEERS                           // Musketeers on one row or collumn that win for the soldiers.
+#endif
+#if N < 3 || N > 7
+#error "N must be from 3 to 7, a move is stored in one byte"
+#endif
+#if MUSKETEERS < 1 || MUSKETEERS >= N*N || WIN_LINE < 1 || WIN_LINE > MUSKETEERS || WIN_LINE > N
+#error "MUSKETEERS and WIN_LINE do not fit the board"
+#endif
+
+#define BIT(square) ((Bitboard)1 << (square))        // Single square mask, square = row*N + collumn.
+#define FULL_MASK (((Bitboard)1 << (N*N)) - 1)        // All squares of the board.
+#define ROW_MASK(row) ((((Bitboard)1 << N) - 1) << ((row)*N))
+#define COL_MASK(col) ((FULL_MASK / (((Bitboard)1 << N) - 1)) << (col))
+#define NEIGHBOUR_MASK(square) ((BIT(square) >> N | BIT(square) << N | (BIT(square) & ~COL_MASK(0)) >> 1 \
+                                | (BIT(square) & ~COL_MASK(N-1)) << 1) & FULL_MASK)
+
+// LIST(count, F, a) is F(a, 0), ..., F(a, count-1) and TABLE(count, F) is F(0, 0), ..., F(count-1, count-1)
+// row by row, so the tables below are built by the compiler for the N the program is compiled with.
+#define LIST_1(F, a) F(a, 0)
+#define LIST_2(F, a) LIST_1(F, a), F(a, 1)
+#define LIST_3(F, a) LIST_2(F, a), F(a, 2)
+#define LIST_4(F, a) LIST_3(F, a), F(a, 3)
+#define LIST_5(F, a) LIST_4(F, a), F(a, 4)
+#define LIST_6(F, a) LIST_5(F, a), F(a, 5)
+#define LIST_7(F, a) LIST_6(F, a), F(a, 6)
+#define LIST(count, F, a) LIST_EXPAND(count, F, a)
+#define LIST_EXPAND(count, F, a) LIST_##count(F, a)
+#define TABLE_1(F) LIST(N, F, 0)
+#define TABLE_2(F) TABLE_1(F), LIST(N, F, 1)
+#define TABLE_3(F) TABLE_2(F), LIST(N, F, 2)
+#define TABLE_4(F) TABLE_3(F), LIST(N, F, 3)
+#define TABLE_5(F) TABLE_4(F), LIST(N, F, 4)
+#define TABLE_6(F) TABLE_5(F), LIST(N, F, 5)
+#define TABLE_7(F) TABLE_6(F), LIST(N, F, 6)
+#define TABLE(count, F) TABLE_EXPAND(count, F)
+#define TABLE_EXPAND(count, F) TABLE_##count(F)
+
+#define ROW_ENTRY(unused, row) ROW_MASK(row)
+#define COL_ENTRY(unused, col) COL_MASK(col)
+#define NEIGHBOUR_ENTRY(row, col) NEIGHBOUR_MASK((row)*N + (col))
+#define IDENTITY(i, j) ((i)*N + (j))
+#define ROTATE_90(i, j) ((j)*N + (N-1-(i)))
+#define ROTATE_180(i, j) ((N-1-(i))*N + (N-1-(j)))
+#define ROTATE_270(i, j) ((N-1-(j))*N + (i))
+#define MIRROR_LEFT_RIGHT(i, j) ((i)*N + (N-1-(j)))
+#define MIRROR_UP_DOWN(i, j) ((N-1-(i))*N + (j))
+#define MIRROR_DIAGONAL(i, j) ((j)*N + (i))
+#define MIRROR_ANTIDIAGONAL(i, j) ((N-1-(j))*N + (N-1-(i)))
+#define MAX_MOVES (4*N*N)                             // Upper bound of the legal moves in any position.
+
+#define MOVE(square, direction) ((Move)((square) << 2 | (direction)))
+#define MOVE_FROM(move) ((move) >> 2)                 // The square of the moving piece.
+#define MOVE_DIRECTION(move) ((move) & 3)              // One of the Direction values.
+#define NO_MOVE ((Move)0xFF)                          // Not a move, used for empty slots.
+
+#define MAX_PLY (2*(N*N - MUSKETEERS) + 20)           // Deeper than the longest possible game, 64 on the 5x5 board.
+#define WIN_SCORE 30000                               // Score of a win at the root, a win at ply p scores WIN_SCORE - p.
+#define INFINITE_SCORE 32000
+#define DEFAULT_HASH_SIZE 16                          // Megabytes of the transposition table.
+#define DEFAULT_TIME_LIMIT 1000                       // Milliseconds the computer may think for a move.
+#define DEFAULT_PLAYOUTS 200000                       // Playouts of the MCTS player per move.
+#define MCTS_EXPLORATION 1.0                          // Weight of the exploration term of UCT.
+#define MAX_GAME_MOVES (2*N*N)                        // Every musketeer move captures, so no game is longer.
+#define RECORD_MAGIC "3MGR"
+#define RECORD_VERSION 1
+#define RECORD_HEADER_SIZE 26                         // Bytes before the moves of a game record.
+#define RECORD_BUFFER (1 << 16)                       // Bytes of records a self-play thread collects before writing.
+#define DEFAULT_SERVER_GAMES 1024                     // Game slots of the server.
+#define SLOT_LINE 16                                  // Longest request line of a client, with the newline.
+#define SLOT_OUTPUT 256                               // Reply bytes a slot keeps until the client reads them.
+#define PN_INFINITE 100000000u                        // Proof or disproof number of a decided position.
+#define PROOF_BUCKET 4                                // Entries of the proof table that share an index.
+#define BOOK_MAGIC "3MBOOK01"
+#define DEFAULT_BOOK_PLIES 4                          // Plies from the start positions the book covers.
+#define DEFAULT_BOOK_DEPTH 12                         // Search depth of every book position.
+#define SOLVE_MAGIC "3MSOLVE1"
+#define SOLVE_DONE (-1)                               // Claim of a root move that is searched.
+#define SOLVE_FAILED (-2)                             // Claim of a root move whose workers crashed SOLVE_RETRIES times.
+#define SOLVE_RETRIES 3                               // Crashes of the workers on one root move before it is given up.
+#define DEFAULT_CHECKPOINT_INTERVAL 60                // Seconds between checkpoints of a multi-process solve.
+#define DEFAULT_ANALYSIS_DEPTH 12                     // Search depth of every position of an analysed game.
+#define INACCURACY_LOSS 16                            // Score a move may lose against the best one and still count as best.
+#define BLUNDER_LOSS 64                               // Score lost by a blunder, or any move that throws away a win.
+#define DEFAULT_BENCH_REPETITIONS 10                  // Measured repetitions of every benchmark workload.
+#define DEFAULT_BENCH_DEPTH 8                         // Search depth of the search workload.
+#define BENCH_WARMUP 3                                // Repetitions run before the measured ones.
+#define BENCH_SAMPLE_TIME 50.0                        // Milliseconds one repetition of a workload aims for.
+#define BENCH_PLIES 3                                 // Plies from the input boards of the positions the workloads use.
+#define BENCH_SEARCH_BOARDS 8                         // Input boards the search workload searches at most.
+#define DEFAULT_BATCH_DEPTH 6                         // Search depth of the batch analysis when --depth is not given.
+#define DEFAULT_SELF_PLAY_DEPTH 4                     // Search depth of the search policy in self-play.
+#define BATCH_BLOCK 4096                              // Boards parsed before the thread pool analyses them.
+
+#define SYMMETRIES 8                                  // Rotations and reflections of the square board.
+#define SQUARE_BYTES ((N*N + 7) / 8)                  // Bytes of a set of squares, the lookup tables work a byte at a time.
+#define BATCH_CACHE (1 << 20)                         // Results the batch analysis keeps for boards seen again.
+#define WEIGHTS_MAGIC "3MWEIGHT"
+#define NEIGHBOUR_PATTERNS 6561                       // 3^8 ways to fill the 8 blocks around a musketeer.
+#define ALIGNMENT_PATTERNS (MUSKETEERS*N)             // Most musketeers on one row(or collumn) and their spread.
+#define NEIGHBOUR_WEIGHTS 0                           // Start of every table in the pattern weights.
+#define ALIGNMENT_WEIGHTS (NEIGHBOUR_WEIGHTS + NEIGHBOUR_PATTERNS)
+#define MUSKETEER_MOVE_WEIGHTS (ALIGNMENT_WEIGHTS + ALIGNMENT_PATTERNS*ALIGNMENT_PATTERNS)
+#define SOLDIER_MOVE_WEIGHTS (MUSKETEER_MOVE_WEIGHTS + 4*MUSKETEERS + 1)
+#define PATTERN_WEIGHTS (SOLDIER_MOVE_WEIGHTS + 4*N*N + 1)
+#define PATTERN_FEATURES (MUSKETEERS + 3)             // Weights that add up to the score of a position.
+#define WEIGHT_LIMIT 2000                             // Largest weight, so a score stays far below WIN_SCORE.
+#define TUNE_SCALE 0.01                               // The musketeers win with chance 1/(1 + e^(-TUNE_SCALE*score)).
+#define TUNE_RATE 1.0                                 // Adam step of the tuner, in score units.
+#define DEFAULT_TUNE_EPOCHS 500
+#define TABLEBASE_MAGIC "3MTBASE2"
+#define DEFAULT_TABLEBASE_SOLDIERS 5                  // Largest soldier count built by default.
+#define TB_NONE 0                                     // Tablebase value of a position that is not stored.
+#define TB_WIN(plies) (1 + (plies))                   // The player to move wins in the given plies.
+#define TB_LOSS(plies) (128 + (plies))                // The player to move loses in the given plies.
+#define TB_DRAW 255                                   // Neither side can force a win.
+#define TB_IS_WIN(value) ((value) >= 1 && (value) < 128)
+#define TB_IS_LOSS(value) ((value) >= 128 && (value) < TB_DRAW)
+#define TB_PLIES(value) (TB_IS_WIN(value) ? (value) - 1 : (value) - 128)
+
+// The AVX2 evaluator works on 8 boards of 32 bits at once, it is chosen at run time when the CPU has AVX2.
+#if (defined(__x86_64__) || defined(__i386__)) && N*N <= 32 && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AVX2_EVALUATOR 1
+#endif
+
+// Metrics are compiled in with -DMETRICS, without it the counters are not even evaluated.
+#ifdef METRICS
+#define METRIC_ADD(metric, value) metricAdd(metric, value)
+#define METRIC_THINK_TIME(ms) metricThinkTime(ms)
+#else
+#define METRIC_ADD(metric, value) ((void)0)
+#define METRIC_THINK_TIME(ms) ((void)0)
+#endif
+#define THINK_BUCKETS 14                              // Think time histogram buckets, the last one has no limit.
 
 /**
- * @brief Reads the board from a file.
+ * @brief A set of board squares, one bit per square.
+ */
+#if N*N > 32
+typedef uint64_t Bitboard;
+#define POPCOUNT(squares) __builtin_popcountll(squares)
+#define FIRST_SQUARE(squares) __builtin_ctzll(squares)
+#else
+typedef uint32_t Bitboard;
+#define POPCOUNT(squares) __builtin_popcount(squares)
+#define FIRST_SQUARE(squares) __builtin_ctz(squares)   // Lowest set square, squares must not be empty.
+#endif
+
+/**
+ * @brief The game state as two bitboards.
  * 
- * This function reads the board from a file, given by the user on the command line.
- * It checks if the number of arguements is correct and if the input file given by the user exists.
- * If any of the above is not correct, the function prints an error message and returns false, else returns true.
+ * Bit row*N + collumn is set in musketeers when an 'M' stands on that block,
+ * and in soldiers when an 'o' stands on it. Empty blocks('.') have neither bit set.
+ * The side to move is not part of the position, it is given to every function that needs it.
+ * The line counts and contacts are the state of the win check. makeMove and unmakeMove update them
+ * with the pieces, so getWinner only reads two numbers.
+ */
+typedef struct {
+    Bitboard musketeers;
+    Bitboard soldiers;
+    uint64_t hashes[SYMMETRIES];       // Zobrist hash of the pieces moved by every symmetry, hashes[0] of the pieces
+                                       // as they stand. Kept up to date by makeMove and unmakeMove.
+    uint8_t lineCount[2*N];            // Musketeers on every row(0 to N-1) and collumn(N to 2N-1).
+    uint8_t fullLines;                 // Rows and collumns holding WIN_LINE musketeers or more.
+    uint8_t contacts;                  // Sum over the musketeers of their neighbour soldiers.
+} Position;
+
+/**
+ * @brief The result of a win check.
+ */
+typedef enum {
+    NO_WINNER,
+    MUSKETEERS_WIN,
+    SOLDIERS_WIN
+} Winner;
+
+/**
+ * @brief A move packed in one byte: the square of the moving piece times 4 plus the direction.
+ */
+typedef uint8_t Move;
+
+/**
+ * @brief The four directions a piece can move to.
+ */
+typedef enum {
+    UP,
+    DOWN,
+    LEFT,
+    RIGHT
+} Direction;
+
+const int directionOffset[4] = {-N, N, -1, 1};   // Square difference for each Direction.
+
+const Bitboard rowMask[N] = {LIST(N, ROW_ENTRY, 0)};                 // rowMask[i] has the N squares of row i set.
+const Bitboard colMask[N] = {LIST(N, COL_ENTRY, 0)};                 // colMask[j] has the N squares of collumn j set.
+const Bitboard neighbourMask[N*N] = {TABLE(N, NEIGHBOUR_ENTRY)};     // The squares up, down, left and right of s.
+uint64_t zobristKeys[2][N*N];          // Random keys of a musketeer(0) or a soldier(1) on every square.
+uint64_t zobristSide;                  // Key xored in when the soldiers are to move.
+const int symmetrySquare[SYMMETRIES][N*N] = {                       // The square s goes to under rotation or reflection t.
+    {TABLE(N, IDENTITY)}, {TABLE(N, ROTATE_90)}, {TABLE(N, ROTATE_180)}, {TABLE(N, ROTATE_270)},
+    {TABLE(N, MIRROR_LEFT_RIGHT)}, {TABLE(N, MIRROR_UP_DOWN)}, {TABLE(N, MIRROR_DIAGONAL)}, {TABLE(N, MIRROR_ANTIDIAGONAL)}
+};
+const int inverseSymmetry[SYMMETRIES] = {0, 3, 2, 1, 4, 5, 6, 7};   // The rotations by 90 and 270 undo each other, the rest themselves.
+Bitboard symmetryBytes[SYMMETRIES][SQUARE_BYTES][256];              // Byte b of a set of squares, moved by symmetry t.
+Move symmetryMoves[SYMMETRIES][256];                                // A move moved by symmetry t, NO_MOVE stays NO_MOVE.
+uint64_t symmetryKeys[2][N*N][SYMMETRIES];                          // Zobrist key of a piece on square s moved by symmetry t.
+uint64_t zobristBytes[2][SQUARE_BYTES][256];                        // Zobrist hash of the musketeers(0) or soldiers(1) of byte b.
+uint8_t patternShifts[N*N][3];                                      // Shift of the 3 blocks above, on and below the row of s.
+uint16_t patternOffBoard[N*N];                                      // The blocks of the 3x3 window around s off the board.
+uint16_t patternIndex[512];                                         // Neighbour pattern of a 3x3 window, the center left out.
+
+/**
+ * @brief One slot of the transposition table.
  * 
- * @param board The 2D character array that represents the game board.
- * @param argc The number of command-line arguements.
- * @param argv The command-line arguement  -  name of the input file.
-*/
-bool readBoard(char board[N][N], int argc, char **argv);
+ * The data word packs score, depth, bound and best move. The check word is the
+ * hash key xored with the data, so a slot written half by one thread and half by
+ * another never matches a key and is simply ignored.
+ */
+typedef struct {
+    uint64_t check;
+    uint64_t data;
+} TableEntry;
 
 /**
- * @brief Displays the board in the console.
+ * @brief A fixed-size hash table of searched positions.
+ */
+typedef struct {
+    TableEntry *entries;
+    uint64_t mask;                     // Number of entries minus one, the number of entries is a power of two.
+    uint8_t generation;                // Increased for every search, older entries are replaced first.
+} TranspositionTable;
+
+/**
+ * @brief The kind of score stored in the transposition table.
+ */
+typedef enum {
+    BOUND_EXACT,
+    BOUND_LOWER,                       // The score is at least the stored one(beta cutoff).
+    BOUND_UPPER                        // The score is at most the stored one(no move raised alpha).
+} Bound;
+
+/**
+ * @brief The state of one search.
  * 
- * This function prints the current state of your board to the console.
+ * Everything a search writes lives here, so different searches can run at the same time.
+ */
+typedef struct {
+    TranspositionTable *table;
+    Move killers[MAX_PLY][2];          // Two moves per ply that caused a beta cutoff.
+    int history[2][MAX_MOVES];         // Cutoff counts per side and move.
+    uint64_t nodes;
+    int maxDepth;
+    int timeLimit;                     // Milliseconds, 0 for no limit.
+    int targetDepth;                   // Return after this depth even with time left, 0 to use all the time.
+    double startTime;
+    bool stop;                         // Set when the time is over, the search unwinds right away.
+    atomic_bool *cancel;               // Set by another thread to stop the search, NULL for none.
+    bool verbose;                      // Print one line per finished depth.
+    Move rootMove;                     // Best move of the depth that is being searched.
+    Move bestMove;                     // Best move of the last finished depth.
+    int bestScore;
+    int completedDepth;
+} SearchContext;
+
+/**
+ * @brief The ways a side can choose its moves without a human.
+ */
+typedef enum {
+    RANDOM_POLICY,                     // Any legal move.
+    GREEDY_POLICY,                     // The move with the best evaluation one ply ahead.
+    SEARCH_POLICY                      // The move of searchBestMove.
+} Policy;
+
+/**
+ * @brief Why a move is not legal, for the checks of checkBoardLimit, checkCurrentBlock and checkDestinationBlock.
+ */
+typedef enum {
+    MOVE_OK,
+    MOVE_OFF_BOARD,                    // The move gets out of the board.
+    MOVE_WRONG_PIECE,                  // The block does not hold a piece of the player.
+    MOVE_WRONG_DESTINATION             // The destination is not a soldier(musketeers) or not empty(soldiers).
+} MoveError;
+
+const char *moveErrorText[] = {"ok", "move gets out of the board", "not a piece of the player", "wrong destination block"};
+
+/**
+ * @brief Why a move script stops, the first values follow MoveError.
+ */
+typedef enum {
+    SCRIPT_OK,
+    SCRIPT_OFF_BOARD,
+    SCRIPT_WRONG_PIECE,
+    SCRIPT_WRONG_DESTINATION,
+    SCRIPT_SYNTAX,                     // The text is not a move.
+    SCRIPT_GAME_OVER,                  // A move after the end of the game.
+    SCRIPT_TOO_LONG                    // More than MAX_GAME_MOVES moves.
+} ScriptError;
+
+const char *scriptErrorText[] = {"ok", "move gets out of the board", "not a piece of the player", "wrong destination block",
+                                 "wrong input syntax", "the game is already over", "too many moves"};
+
+/**
+ * @brief The outcome of a move script.
+ */
+typedef struct {
+    ScriptError error;                 // SCRIPT_OK when every move was played.
+    int plies;                         // Moves played, an error is at ply plies + 1.
+    char move[8];                      // The failing move as written, cut to 7 characters.
+    Winner winner;                     // The winner after the moves played.
+} ScriptResult;
+
+/**
+ * @brief A game as its starting position and its moves, the musketeers move first.
+ * 
+ * In a record file every game is a header followed by one byte per move:
  * 
- * @param board The 2D character array that represents the game board.
+ *     0  "3MGR"          4 bytes
+ *     4  version         1 byte, RECORD_VERSION
+ *     5  board size      1 byte, N
+ *     6  result          1 byte, a Winner value
+ *     7  reserved        1 byte, 0
+ *     8  musketeers      8 bytes, little endian
+ *    16  soldiers        8 bytes, little endian
+ *    24  move count      2 bytes, little endian
+ *    26  moves           one Move per byte(square * 4 + direction, 7 bits)
+ * 
+ * Games are appended one after another, so a file can collect any number of them.
  */
-void displayBoard(char board[N][N]);
+typedef struct {
+    Position start;
+    Winner result;                     // NO_WINNER for a game that was left before the end.
+    int moveCount;
+    Move moves[MAX_GAME_MOVES];
+} GameRecord;
 
 /**
- * @brief Reads and chacks the player's move.
+ * @brief The ways the computer can find its moves in play().
+ */
+typedef enum {
+    ALPHA_BETA_ENGINE,                 // searchBestMove
+    MCTS_ENGINE                        // mctsBestMove
+} Engine;
+
+/**
+ * @brief One node of the Monte Carlo search tree.
  * 
- * This function reads the players move, and checks it's format.
- * While there is a mistake, a mistake message is printed and the user is asked to make a new move.
+ * All counters are atomic, so the threads update them without locks.
+ * The children of a node are next to each other in the arena.
+ */
+typedef struct {
+    atomic_int visits;                 // Finished playouts through the node.
+    atomic_int wins;                   // Of those, the ones won by the player that moved into the node.
+    atomic_int virtualLosses;          // Playouts in flight through the node, counted as losses while they run.
+    atomic_int childCount;             // 0 for a leaf, -1 while a thread expands it.
+    uint32_t firstChild;               // Arena index of the first child, valid when childCount > 0.
+    Move move;                         // The move that leads to the node.
+} MctsNode;
+
+/**
+ * @brief A Monte Carlo search tree with its node arena.
+ */
+typedef struct {
+    MctsNode *nodes;                   // The arena, node 0 is the root.
+    size_t capacity;
+    atomic_size_t used;
+    const Position *root;
+    char player;                       // The player to move at the root.
+    atomic_long playouts;              // Playouts started so far, the finished ones are the root visits.
+    long maxPlayouts;
+    int timeLimit;                     // Milliseconds, 0 for no limit.
+    double startTime;
+} MctsTree;
+
+/**
+ * @brief One MCTS thread with its own random numbers.
+ */
+typedef struct {
+    MctsTree *tree;
+    uint64_t random;
+} MctsWorker;
+
+/**
+ * @brief A search of the human's position that runs while the human types a move.
  * 
- * @param str A character array to store the players input.
- * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
- * @return false Returns false when player wants to exit the game.
- * @return true Returns true when player does not want to exit the game.
+ * It searches its own copy of the position and fills the transposition table of play(), so the
+ * search after the human's move finds the replies to every move of the human already stored.
  */
-bool readInputMove(char *str, char player);
+typedef struct {
+    SearchContext ctx;
+    Position pos;                      // Copy of the position, the board itself changes with the human's move.
+    char player;                       // The human.
+    atomic_bool cancel;
+    pthread_t thread;
+    bool running;
+} Ponder;
 
 /**
- * @brief Checks if the destination block is correct.
+ * @brief The options given on the command line.
+ */
+typedef struct {
+    char *boardFile;                   // Name of the input file.
+    bool computerMusketeers;           // The computer plays the musketeers.
+    bool computerSoldiers;             // The computer plays Cardinal Richelieu's men.
+    int depth;                         // Maximum search depth.
+    int timeLimit;                     // Milliseconds per computer move, 0 for no limit.
+    int hashSize;                      // Megabytes of the transposition table.
+    long selfPlayGames;                // Number of self-play games, 0 to play normally.
+    int threads;                       // Number of worker threads.
+    Policy musketeerPolicy;            // How the musketeers move in self-play.
+    Policy soldierPolicy;              // How the soldiers move in self-play.
+    uint64_t seed;                     // Seed of the self-play policies.
+    bool seedGiven;                    // --seed was given, otherwise the seed is the current time.
+    char *tablebaseFile;               // Tablebase to load, NULL for none.
+    char *buildTablebaseFile;          // Tablebase to build, NULL to play normally.
+    int tablebaseSoldiers;             // Largest soldier count to build.
+    char **inputFiles;                 // Every arguement that is not an option.
+    int inputCount;
+    char *batchFile;                   // Output of the batch analysis, NULL to play normally.
+    int perftDepth;                    // Depth of the move path count, 0 to play normally.
+    bool divide;                       // Print the count of every root move.
+    int perftHashSize;                 // Megabytes of the perft cache, 0 for none.
+    Engine engine;                     // How the computer finds its moves.
+    long playouts;                     // Playouts per move of the MCTS engine.
+    char *recordFile;                  // Games are appended to this file, NULL for none.
+    char *replayFile;                  // Record file to replay, NULL to play normally.
+    char *scriptFile;                  // File of move scripts to check, "-" for the standard input, NULL for none.
+    char *analyseFile;                 // Record file with a game to analyse, NULL to play normally.
+    long analyseGame;                  // Number of the game to analyse, from 1.
+    bool staticBatch;                  // The batch analysis only evaluates the boards, without search.
+    char solvePlayer;                  // The side to move of --solve, 0 to play normally.
+    int processes;                     // Worker processes of the alpha-beta solve, 0 for the df-pn solver.
+    char *checkpointFile;              // Checkpoint of the multi-process solve, NULL for none.
+    int checkpointInterval;            // Seconds between checkpoints.
+    bool ponder;                       // Search while the human thinks.
+    char *bookFile;                    // Opening book to load, NULL for none.
+    char *buildBookFile;               // Opening book to build, NULL to play normally.
+    char *weightsFile;                 // Pattern weights for evaluate(), NULL for the handwritten evaluation.
+    char *tuneFile;                    // Pattern weights to tune and write, NULL to play normally.
+    char *tuneGamesFile;               // Record file of the games the tuner learns from.
+    int tuneEpochs;                    // Gradient descent steps of the tuner.
+    int bookPlies;                     // Plies of the book to build.
+    char *metricsFile;                 // Base name of the metrics files, NULL for none.
+    char *benchFile;                   // JSON output of the benchmark, NULL to play normally.
+    int benchRepetitions;              // Measured repetitions of every workload.
+    char *serverSocket;                // Unix socket path of the game server, NULL to play normally.
+    int serverGames;                   // Game slots of the server.
+} Options;
+
+/**
+ * @brief One game of the server, a slot of the preallocated pool.
+ */
+typedef struct {
+    int fd;                            // Connection of the client, -1 for a free slot.
+    int nextFree;                      // Next slot of the free list.
+    Position pos;
+    char player;                       // The player to move.
+    bool closing;                      // Close the connection when the output is sent.
+    bool waitOutput;                   // EPOLLOUT is requested, the socket was full.
+    bool thinking;                     // A search thread looks for the computer's move, the slot stays taken.
+    GameRecord record;
+    int lineLength;
+    int outputLength;
+    char line[SLOT_LINE];              // The request line read so far.
+    char output[SLOT_OUTPUT];          // Replies not sent yet.
+} GameSlot;
+
+/**
+ * @brief A computer move of a server game, searched by a thread of the server.
+ */
+typedef struct {
+    int slot;                          // The game.
+    Position pos;                      // A copy, the loop keeps the game.
+    char player;
+    Move move;                         // Output.
+} ServerJob;
+
+/**
+ * @brief The game server: the slot pool, the sockets, the search threads and the table they share.
  * 
- * Checks if the destination block for Musketeers is 'o' and if
- * the destination block for the enemy is '.'.
+ * A slot has at most one job, so both rings hold slotCount jobs. Finished games are encoded into a queue
+ * that a writer thread appends to the record file, so the loop never waits for the disk.
+ */
+typedef struct {
+    GameSlot *slots;
+    int slotCount;
+    int freeSlot;                      // First slot of the free list, -1 when all are in use.
+    int listenFd;
+    int epollFd;
+    const Position *start;
+    const Options *options;
+    TranspositionTable table;
+    ServerJob *jobs;                   // Ring of the positions to search.
+    int jobHead;
+    int jobCount;
+    ServerJob *results;                // Ring of the moves found, the loop plays them.
+    int resultHead;
+    int resultCount;
+    pthread_mutex_t lock;              // Guards both rings, the record queue and stopping.
+    pthread_cond_t wake;               // A job was added or the server stops.
+    bool stopping;
+    int eventFd;                       // Written by a thread after adding a result, the loop watches it.
+    pthread_t *threads;
+    int threadCount;
+    FILE *record;                      // The record file, NULL for none, only the writer thread writes it.
+    uint8_t *records;                  // Encoded games the writer has not taken yet, NULL when there are none.
+    size_t recordLength;
+    size_t recordCapacity;
+    pthread_cond_t recordWake;         // A game was queued or the server stops.
+    pthread_t writer;
+    bool writerRunning;
+    long games;                        // Games started.
+    long moves;
+} GameServer;
+
+/**
+ * @brief One self-play thread with its own board, random numbers and results.
+ */
+typedef struct {
+    const Options *options;
+    const Position *start;             // The starting position, only read.
+    long games;                        // Games this thread plays.
+    uint64_t random;                   // State of the random number generator.
+    long musketeerWins;
+    long soldierWins;
+    long lengths[MAX_PLY + 1];         // Number of games that ended after each number of plies.
+    bool failed;                       // The transposition table could not be allocated.
+    FILE *record;                      // Shared record file, NULL for none.
+    pthread_mutex_t *recordLock;       // Held while a thread writes its buffer to the record file.
+    uint8_t buffer[RECORD_BUFFER];     // Encoded games not written yet.
+    size_t buffered;
+} SelfPlayWorker;
+
+/**
+ * @brief The start of a tablebase file.
  * 
- * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
- * @param destinationBlock The character in the destination block.
- * @return true Returns true when destination is valid.
- * @return false Returns false when destination block is not valid.
+ * The values follow in layers, one per soldier count and player to move. Inside a layer the value
+ * of a position is at class * C(N*N - MUSKETEERS, soldiers) + rank of the soldiers, where class is the
+ * symmetry class of the musketeers and the soldiers are ranked among the squares without a musketeer.
  */
-bool checkDestinationBlock(char player, char destinationBlock);
+typedef struct {
+    char magic[8];                     // TABLEBASE_MAGIC
+    uint32_t boardSize;                // N
+    uint32_t musketeers;               // MUSKETEERS
+    uint32_t winLine;                  // WIN_LINE
+    uint32_t maxSoldiers;              // Layers 0 to maxSoldiers are stored.
+    uint32_t classCount;               // Number of musketeer symmetry classes.
+    uint64_t offsets[N*N + 1][2];      // Start of every layer, [soldiers][0 musketeers to move, 1 soldiers to move].
+    uint64_t size;                     // Size of the file.
+} TablebaseHeader;
 
 /**
- * @brief Check if the current block is valid.
+ * @brief A tablebase file mapped in memory.
  * 
- * Check if the block that is trying to by moved is a Musketeer, when musketeer makes a move,
- * and check if it is a soldier, when the enemy makes a move.
+ * Every stored value is TB_WIN, TB_LOSS or TB_DRAW with the distance in plies to the end of the game
+ * with perfect play, for the player to move.
+ */
+typedef struct {
+    uint8_t *data;                     // The mapped file, NULL when no tablebase is loaded.
+    size_t size;
+    int maxSoldiers;
+} Tablebase;
+
+/**
+ * @brief The symmetry class of a set of musketeer squares.
+ */
+typedef struct {
+    int16_t index;                     // Number of the class.
+    uint8_t symmetries;                // Bit t is set when symmetry t maps the set to the class representative.
+} MusketeerClass;
+
+/**
+ * @brief One board of the batch analysis.
+ */
+typedef struct {
+    const char *file;                  // The file the board was read from.
+    long number;                       // Number of the board in the file, from 1.
+    Position pos;
+    const char *error;                 // Why the board is not legal, NULL for a legal board.
+    Winner winner;
+    int score;                         // Search score for the musketeers to move.
+    Move move;                         // Best move of the musketeers, NO_MOVE when the game is over.
+    uint8_t symmetry;                  // Takes the board to its canonical form.
+    int source;                        // The board of the block analysed for this one, -1 when the cache had it.
+} BatchItem;
+
+/**
+ * @brief The result of one canonical board of the batch analysis.
+ */
+typedef struct {
+    Bitboard musketeers;               // 0 for an empty slot, a legal board has musketeers.
+    Bitboard soldiers;
+    int16_t score;
+    uint8_t winner;
+    Move move;                         // In the canonical form.
+    int owner;                         // The board of the current block being analysed for it, -1 when the result is in.
+} BatchCacheEntry;
+
+/**
+ * @brief The block of boards shared by the batch thread pool.
  * 
- * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
- * @param currentBlock The character in the current block.
- * @return true Returns true when character in the current block is valid.
- * @return false Returns false when character in the current block is not valid.
+ * The main thread fills the block, then all threads meet at start, take boards from next
+ * until the block is done and meet again at done.
  */
-bool checkCurrentBlock(char player, char currentBlock);
+typedef struct {
+    BatchItem items[BATCH_BLOCK];
+    int count;
+    atomic_int next;                   // Next board to analyse.
+    bool finished;                     // No more blocks, the threads return after start.
+    const Options *options;
+    pthread_mutex_t gate;              // Held while the threads start, the barriers count those that did.
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+} BatchQueue;
 
 /**
- * @brief Checks if the move is in the board limit.
+ * @brief Many positions in structure-of-arrays layout for evaluateBatch().
  * 
- * The function checks if the direction the user gives, takes the piece out of the board limits.
+ * Position i is musketeers[i] and soldiers[i], the results of position i are at index i of the
+ * output arrays. The arrays are aligned to 32 bytes.
+ */
+typedef struct {
+    Bitboard *musketeers;              // Input.
+    Bitboard *soldiers;
+    uint8_t *winners;                  // Output, the Winner that getWinner returns.
+    uint8_t *musketeerMoves;           // Output, legal moves of the musketeers.
+    uint8_t *soldierMoves;             // Output, legal moves of the soldiers.
+    int16_t *scores;                   // Output, evaluate() for the musketeers.
+    size_t count;                      // Positions in the batch.
+    size_t capacity;
+} EvaluationBatch;
+
+/**
+ * @brief One thread of the batch thread pool with its own transposition table.
+ */
+typedef struct {
+    BatchQueue *queue;
+    TranspositionTable table;
+} BatchWorker;
+
+/**
+ * @brief One slot of the perft cache.
  * 
- * @param row The row character of the current piece.
- * @param col The collumn character of the current piece.
- * @param direction The direction character(U\u D\d R\r L\l).
- * @return true Returns true if the move is within the board limits.
- * @return false Returns false if the move is not within the board limits.
+ * The check word is the key xored with the count, so threads can share the cache without locks.
  */
-bool checkBoardLimit(char row, char col, char direction);
+typedef struct {
+    uint64_t check;
+    uint64_t count;
+} PerftEntry;
 
 /**
- * @brief Converts row input.
+ * @brief A fixed-size cache of subtree counts, keyed by position, player to move and depth.
+ */
+typedef struct {
+    PerftEntry *entries;
+    uint64_t mask;                     // Number of entries minus one, the number of entries is a power of two.
+} PerftTable;
+
+/**
+ * @brief One thread of perft, it takes root moves from a shared counter.
+ */
+typedef struct {
+    const Position *start;
+    char player;
+    const Move *moves;                 // The root moves.
+    int moveCount;
+    uint64_t *counts;                  // Count of every root move.
+    atomic_int *nextMove;
+    PerftTable *table;                 // NULL for no cache.
+    int depth;
+} PerftWorker;
+
+/**
+ * @brief Proof and disproof numbers of a position, for the side to move winning.
+ */
+typedef struct {
+    uint64_t key;                      // positionKey, 0 for an empty entry.
+    uint32_t pn;                       // 0 when the side to move wins.
+    uint32_t dn;                       // 0 when the side to move loses.
+    uint64_t work;                     // Nodes searched below the position, the least is replaced first.
+} ProofEntry;
+
+/**
+ * @brief The state of a proof-number search.
+ */
+typedef struct {
+    ProofEntry *entries;               // Buckets of PROOF_BUCKET entries.
+    uint64_t mask;                     // Number of buckets minus one, a power of two minus one.
+    uint64_t nodes;
+    uint64_t replaced;                 // Entries overwritten because the bucket was full.
+    int ply;                           // Depth of the node being searched, 0 at the root.
+    uint32_t rootPn;                   // Last numbers of the root, for the progress lines.
+    uint32_t rootDn;
+    double startTime;
+    double nextReport;                 // Time of the next progress line.
+} ProofSearch;
+
+/**
+ * @brief The positions of a recorded game and their searches, shared by the analysis threads.
+ */
+typedef struct {
+    Position positions[MAX_GAME_MOVES + 1]; // Position i is the one before move i, the last one ends the game.
+    char players[MAX_GAME_MOVES + 1];  // The player to move in every position.
+    int scores[MAX_GAME_MOVES + 1];    // Search score of every position for the player to move.
+    Move bestMoves[MAX_GAME_MOVES + 1]; // NO_MOVE when the game is over in the position.
+    int count;                         // Positions, one more than the moves.
+    atomic_int next;                   // Positions handed out, from the last one back to the first.
+    TranspositionTable table;          // Shared, positions next to each other reuse each other's entries.
+    const Options *options;
+} GameAnalysis;
+
+/**
+ * @brief The start of the shared memory of a multi-process solve, the transposition table follows.
  * 
- * This function converts the row input to its integer equivalent to control the board.
+ * The whole segment is also the checkpoint file. Workers claim a root move by setting its claim from
+ * 0 to their process id, and set it to SOLVE_DONE after writing the score. The parent gives the moves
+ * of a crashed worker back by setting their claims to 0 again.
+ */
+typedef struct {
+    char magic[8];                     // SOLVE_MAGIC
+    uint64_t key;                      // positionKey of the root position and the side to move.
+    uint32_t boardSize;                // N
+    uint32_t depth;                    // Search depth of the root.
+    uint64_t tableEntries;             // Entries of the table after the header.
+    int moveCount;                     // Root moves.
+    Move moves[MAX_MOVES];
+    atomic_int claims[MAX_MOVES];      // 0 to search, the process id of the worker, SOLVE_DONE or SOLVE_FAILED.
+    int scores[MAX_MOVES];             // Score of every searched root move for the side to move.
+    int crashes[MAX_MOVES];            // Workers that crashed on the move, only the parent writes them.
+    atomic_uint_fast64_t nodes;        // Nodes of every finished root move.
+} SolveHeader;
+
+/**
+ * @brief A position the tuner learns from.
+ */
+typedef struct {
+    uint32_t features[PATTERN_FEATURES];   // From patternFeatures.
+    float result;                          // 1 when the musketeers won the game, else 0.
+} TuneSample;
+
+/**
+ * @brief A thread of the tuner and its share of the samples.
+ */
+typedef struct {
+    const TuneSample *samples;
+    size_t count;
+    const float *weights;              // The weights of this epoch, shared.
+    double *gradient;                  // PATTERN_WEIGHTS sums of this thread.
+    double loss;                       // Sum of the cross-entropy of the samples.
+} TuneWorker;
+
+/**
+ * @brief The workloads of the benchmark.
+ */
+typedef enum {
+    BENCH_READ_BOARD,                  // readBoard on every input file, with the file I/O.
+    BENCH_PARSE_BOARD,                 // parseBoard on the text of every input file in memory.
+    BENCH_WINNER,                      // getWinner, the check of checkForWinner.
+    BENCH_MOVE_BOARD,                  // Move strings checked and applied like moveBoard, without I/O.
+    BENCH_GENERATE,                    // generateMoves.
+    BENCH_EVALUATE,                    // evaluate.
+    BENCH_SEARCH,                      // Fixed-depth search of the input boards, one operation is one node.
+    BENCH_WORKLOADS
+} BenchWorkload;
+
+/**
+ * @brief The positions and the move strings the benchmark workloads go through.
+ */
+typedef struct {
+    const Options *options;
+    Position *positions;               // Every position a few plies from the input boards.
+    char *players;                     // The player to move of every position.
+    long count;
+    char (*moves)[6];                  // Move strings typed on the positions, legal and illegal.
+    long *moveOwner;                   // The position of every move string.
+    long moveCount;
+    char *text;                        // The text of every input file, one after another.
+    size_t textSize;
+    Position starts[BENCH_SEARCH_BOARDS]; // The input boards the search workload searches.
+    int startCount;
+    TranspositionTable table;          // Cleared before every search.
+    volatile uint64_t sink;            // Every result is added here, so the compiler keeps the work.
+} BenchData;
+
+/**
+ * @brief The measurements of one benchmark workload.
+ */
+typedef struct {
+    const char *name;
+    const char *unit;                  // What one operation is.
+    long passes;                       // Passes over the workload per repetition.
+    uint64_t operations;               // Operations per repetition.
+    double *samples;                   // Nanoseconds per operation of every repetition.
+    double mean, stddev, min, max;
+} BenchResult;
+
+/**
+ * @brief The start of an opening book file, the entries follow sorted by key.
+ */
+typedef struct {
+    char magic[8];                     // BOOK_MAGIC
+    uint32_t boardSize;                // N
+    uint32_t musketeers;               // MUSKETEERS
+    uint32_t winLine;                  // WIN_LINE
+    uint32_t plies;                    // Plies from the start positions.
+    uint64_t count;                    // Number of entries.
+} BookHeader;
+
+/**
+ * @brief The best move of one position of the book.
+ */
+typedef struct {
+    uint64_t key;                      // positionKey of the position and the player to move.
+    int16_t score;                     // Search score for the player to move.
+    Move move;
+    uint8_t depth;                     // Depth of the search.
+    uint32_t reserved;
+} BookEntry;
+
+/**
+ * @brief An opening book mapped with mmap.
+ */
+typedef struct {
+    void *data;                        // The mapped file, NULL when no book is loaded.
+    size_t size;
+    const BookEntry *entries;
+    uint64_t count;
+} OpeningBook;
+
+/**
+ * @brief A collected position of the book builder and its key, sorted to drop the positions reached more than once.
+ */
+typedef struct {
+    uint64_t key;
+    long position;                     // Index of the position and its player in the collected lists.
+} BookPosition;
+
+/**
+ * @brief One thread of the book builder, it takes positions from a shared counter.
+ */
+typedef struct {
+    BookEntry *entries;                // One per position, the key is filled in, the thread adds the rest.
+    long *index;                       // The collected position of every entry.
+    Position *positions;
+    char *players;
+    long count;
+    atomic_long *next;
+    const Options *options;
+    bool failed;                       // The transposition table could not be allocated.
+} BookWorker;
+
+/**
+ * @brief The counters of the metrics, the first four follow MoveError.
+ */
+typedef enum {
+    METRIC_MOVES_ACCEPTED,             // Moves that passed every check.
+    METRIC_REJECTED_BOARD_LIMIT,       // Rejected by checkBoardLimit, MOVE_OFF_BOARD.
+    METRIC_REJECTED_CURRENT_BLOCK,     // Rejected by checkCurrentBlock, MOVE_WRONG_PIECE.
+    METRIC_REJECTED_DESTINATION_BLOCK, // Rejected by checkDestinationBlock, MOVE_WRONG_DESTINATION.
+    METRIC_WIN_CHECKS,
+    METRIC_SEARCH_NODES,
+    METRIC_TABLE_PROBES,
+    METRIC_TABLE_HITS,
+    METRIC_COUNTERS
+} Metric;
+
+#ifdef METRICS
+/**
+ * @brief The metrics of one thread.
  * 
- * @param row The row character.
- * @return char The integer representation of the row character.
+ * Only the owning thread writes them, with relaxed atomics that compile to plain loads and stores.
+ * They are kept after the thread ends and summed over all threads when they are read.
  */
-char convertRowInput(char row);
+typedef struct ThreadMetrics {
+    atomic_uint_fast64_t counters[METRIC_COUNTERS];
+    atomic_uint_fast64_t thinkCounts[THINK_BUCKETS]; // Moves per think time bucket.
+    atomic_uint_fast64_t thinkMicroseconds;          // Total think time.
+    struct ThreadMetrics *next;        // The metrics of the thread registered before.
+} ThreadMetrics;
+#endif
 
 /**
- * @brief Moves the player's piece on the board.
+ * @brief One thread of the tablebase generator.
+ */
+typedef struct {
+    Tablebase *tablebase;
+    int soldiers;                      // The layer being built.
+    char player;                       // The player to move in the layer.
+    atomic_int *nextClass;             // Shared counter of the musketeer classes still to build.
+    long wins;
+    long losses;
+} TablebaseWorker;
+
+uint64_t binomial[N*N + 1][N*N + 1];   // binomial[n][k] is n choose k.
+MusketeerClass *musketeerClasses;      // Class of every set of musketeer squares, by rankSquares.
+Bitboard *classMusketeers;             // Representative(smallest) musketeer set of every class.
+int classCount;
+Tablebase tablebase;                   // Loaded with --tablebase, searches look positions up in it.
+OpeningBook book;                      // Loaded with --book, play() takes its moves first.
+int16_t *patternWeights;               // Loaded with --weights, evaluate() adds up these tables instead.
+volatile sig_atomic_t serverStop = 0;  // Set by SIGINT and SIGTERM to stop the game server.
+#ifdef METRICS
+_Thread_local ThreadMetrics *threadMetrics; // The metrics of the calling thread, NULL until it counts something.
+ThreadMetrics spareMetrics;            // Counts threads whose metrics could not be allocated.
+ThreadMetrics *metricsList = &spareMetrics; // Every registered ThreadMetrics.
+pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+const char *metricsFile;               // Base name of the files the metrics are written to.
+#endif
+const char *metricNames[METRIC_COUNTERS] = {"moves_accepted", "moves_rejected_board_limit", "moves_rejected_current_block",
+                                            "moves_rejected_destination_block", "win_checks", "search_nodes",
+                                            "table_probes", "table_hits"};
+const double thinkBucketLimits[THINK_BUCKETS - 1] = {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000}; // Milliseconds.
+
+/**
+ * @brief Fills the Zobrist keys, the row, collumn, neighbour and symmetry tables are built by the compiler.
  * 
- * This function moves the player's piece on the board after checking if the move is valid.
- * It calls the functions checkBoardLimit, readInputMove, checkCurrentBlock, checkDestinationBlock to check if the move is valid.
- * If the move is not valid, it prints error message and asks for player make a move again, and repeats until given move is correct.
- * When correct input is given, the destination blocks of Musketeers become 'M' and 'o' for soldiers. Their previous blocks, become empty('.').
+ * Must be called once before any position is set up.
+ * The keys come from a fixed seed, so hashes are the same in every run.
+ */
+void initBitboards(void);
+
+/**
+ * @brief Returns the character on a block of the board.
  * 
- * @param input The players input move.
- * @param board The 2D character array that represents the game board.
- * @param player The player that makes the move('M' - Musketeer, 'o' soldier).
- * @return false Returns false, if player wants to exit the game - If readInputMove returns false, moveBoard returns false too, to exit the program in main.
- * @return true Returns true, if player does not want to exit the game.
+ * @param pos The position.
+ * @param row The row of the block(0 to N-1).
+ * @param col The collumn of the block(0 to N-1).
+ * @return char 'M' for a musketeer, 'o' for a soldier and '.' for an empty block.
  */
-bool moveBoard(char input[6], char board[N][N], char player);
+char pieceAt(const Position *pos, int row, int col);
 
 /**
- * @brief Check for winner in the game.
+ * @brief Converts a character board to a position.
  * 
- * This function checks if there is a winner in the game.
- * Checks if there is a line or a collumn with 3 musketeers to find if The soldiers of Richeliu won.
- * Checks if Musketeers have no neighbour soldiers to move, to find if Musketeers won.
- * If there is a winner, a message is printed.
+ * @param board The 2D character array in the text format('M', 'o', '.').
+ * @param pos The position to fill.
+ * @return true Returns true when every character is 'M', 'o' or '.'.
+ * @return false Returns false when an unknown character is found.
+ */
+bool boardToPosition(char board[N][N], Position *pos);
+
+/**
+ * @brief Computes the Zobrist hash of a position from scratch.
  * 
- * @param board The 2D character array that represents the game board.
- * @return true Returns true if winner is found.
- * @return false Returns false if winner if not found.
+ * @param pos The position.
+ * @return uint64_t The xor of the keys of all pieces.
  */
-bool checkForWinner(char board[N][N]);
+uint64_t computeHash(const Position *pos);
 
 /**
- * @brief Starts the game.
+ * @brief Sets up a position from its two bitboards.
  * 
- * This function, manages the game loop and player turns.
- * Calls the readInputMove function to ask the player for input, the moveBoard function to 
- * make changes to the board, and the checkForWinner function to determine whether loop is going to continue.
+ * Computes the hash, the line counts and the contacts from scratch.
+ * Use it for every position that is not reached with makeMove.
  * 
- * @param board The 2D character array that represents the game board.
+ * @param pos The position to fill.
+ * @param musketeers The musketeer squares.
+ * @param soldiers The soldier squares.
  */
-void play(char board[N][N]);
+void setupPosition(Position *pos, Bitboard musketeers, Bitboard soldiers);
 
 /**
- * @brief Writes the current board state to a file.
+ * @brief Puts a musketeer on an empty square and updates hash and win state.
  * 
- * After game is done, this function is called to save the final board to
- * a file with name "out-input-file.txt" where input-file.txt is the file that user typed on the command line
- * before the start of the game.
+ * @param pos The position.
+ * @param square The square.
+ */
+void addMusketeer(Position *pos, int square);
+
+/**
+ * @brief Takes the musketeer off a square and updates hash and win state.
  * 
- * @param board The 2D character array that represents the game board.
- * @param argv The command-line arguement  - name of the input file.
- * @return true 
- * @return false 
+ * @param pos The position.
+ * @param square The square.
  */
-bool writeBoard(char board[N][N], char **argv);
+void removeMusketeer(Position *pos, int square);
 
 /**
- * @brief The main function is the core of the program.
+ * @brief Puts a soldier on an empty square and updates hash and win state.
  * 
- * It initializes the game board, displays instructions to players and 
- * manages the game loop. It checks for winners and saves the final board
- * to a file.
+ * @param pos The position.
+ * @param square The square.
+ */
+void addSoldier(Position *pos, int square);
+
+/**
+ * @brief Takes the soldier off a square and updates hash and win state.
  * 
- * @param argc Number of command-line arguements.
- * @param argv Command-line arguements  -  name of input file.
- * @return int 
+ * @param pos The position.
+ * @param square The square.
  */
-int main(int argc, char **argv) {
+void removeSoldier(Position *pos, int square);
+
+/**
+ * @brief Converts a position back to the character board format.
+ * 
+ * @param pos The position.
+ * @param board The 2D character array to fill with 'M', 'o' and '.'.
+ */
+void positionToBoard(const Position *pos, char board[N][N]);
+
+/**
+ * @brief Finds the winner of a position without printing anything.
+ * 
+ * Soldiers win when all musketeers stand on the same row or collumn.
+ * Musketeers win when no musketeer has a soldier on a neighbour block.
+ * The row and collumn check comes first, like in checkForWinner.
+ * Both checks read the state that makeMove keeps up to date, so the call takes constant time.
+ * 
+ * @param pos The position.
+ * @return Winner NO_WINNER, MUSKETEERS_WIN or SOLDIERS_WIN.
+ */
+Winner getWinner(const Position *pos);
+
+/**
+ * @brief Returns the destination square of a move.
+ * 
+ * @param move The move.
+ * @return int The square the piece moves to.
+ */
+int moveDestination(Move move);
+
+/**
+ * @brief Moves every square of a set one block in a direction.
+ * 
+ * Squares that would leave the board are dropped.
+ * 
+ * @param squares The set of squares.
+ * @param direction One of the Direction values.
+ * @return Bitboard The squares that are reached.
+ */
+Bitboard shiftBoard(Bitboard squares, int direction);
+
+/**
+ * @brief Generates all legal moves of a player.
+ * 
+ * Musketeers move to a neighbour block with a soldier and soldiers move to a neighbour empty block.
+ * The moves are written to the array given by the caller. Nothing is allocated or printed, so the
+ * function can be called in a loop without a terminal attached. It does not check for a winner.
+ * 
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param moves The array that receives the moves.
+ * @return int The number of moves written to the array.
+ */
+int generateMoves(const Position *pos, char player, Move moves[MAX_MOVES]);
+
+/**
+ * @brief Plays a legal move on the position in place.
+ * 
+ * A musketeer captures the soldier on its destination block. The move is not checked.
+ * 
+ * @param pos The position to update.
+ * @param player The player that makes the move('M' - Musketeer, 'o' soldier).
+ * @param move A legal move for the player, as given by generateMoves.
+ */
+void makeMove(Position *pos, char player, Move move);
+
+/**
+ * @brief Takes back a move played with makeMove.
+ * 
+ * A captured soldier is put back on the destination block of a musketeer.
+ * 
+ * @param pos The position to update.
+ * @param player The player that made the move('M' - Musketeer, 'o' soldier).
+ * @param move The move that was played last.
+ */
+void unmakeMove(Position *pos, char player, Move move);
+
+/**
+ * @brief Checks a move without printing anything.
+ * 
+ * The same checks as checkBoardLimit, checkCurrentBlock and checkDestinationBlock, on a position.
+ * 
+ * @param pos The position.
+ * @param player The player that makes the move('M' - Musketeer, 'o' soldier).
+ * @param move The move, any byte.
+ * @return MoveError MOVE_OK for a legal move, else the first check that fails.
+ */
+MoveError validateMove(const Position *pos, char player, Move move);
+
+/**
+ * @brief Converts a move in the input format, for example "A,5=L" or "a,5=l".
+ * 
+ * @param str The move, as checked by readInputMove.
+ * @return Move The move, NO_MOVE when the text is not a move.
+ */
+Move stringToMove(const char *str);
+
+/**
+ * @brief Writes a move in the input format, for example "A,5=L".
+ * 
+ * @param move The move.
+ * @param str A character array of at least 6 characters.
+ */
+void moveToString(Move move, char str[6]);
+
+/**
+ * @brief Reads the command line options.
+ * 
+ * The last arguement that is not an option is the name of the input file.
+ * If an option is unknown or the input file is missing, the usage is printed and false is returned.
+ * 
+ * @param options The options to fill.
+ * @param argc The number of command-line arguements.
+ * @param argv The command-line arguements.
+ * @return true Returns true when the options are valid.
+ * @return false Returns false when the options are not valid.
+ */
+bool parseOptions(Options *options, int argc, char **argv);
+
+/**
+ * @brief Prints the command line options.
+ */
+void printUsage(void);
+
+/**
+ * @brief Reads a policy name.
+ * 
+ * @param name "random", "greedy" or "search".
+ * @param policy Receives the policy.
+ * @return true Returns true when the name is known.
+ * @return false Returns false when the name is unknown.
+ */
+bool parsePolicy(const char *name, Policy *policy);
+
+/**
+ * @brief Returns the next number of a xorshift64* generator.
+ * 
+ * @param state The state of the generator, never 0.
+ * @return uint64_t A random number.
+ */
+uint64_t nextRandom(uint64_t *state);
+
+/**
+ * @brief Chooses a move with a policy.
+ * 
+ * @param policy The policy.
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param random The state of the random number generator.
+ * @param ctx The search used by SEARCH_POLICY.
+ * @return Move The chosen move, NO_MOVE if the player has no legal move.
+ */
+Move choosePolicyMove(Policy policy, Position *pos, char player, uint64_t *random, SearchContext *ctx);
+
+/**
+ * @brief Plays the games of one self-play thread.
+ * 
+ * Every game starts from the starting position and is played without any output.
+ * A game ends when there is a winner or the soldiers cannot move.
+ * 
+ * @param arg The SelfPlayWorker of the thread.
+ * @return void* Always NULL.
+ */
+void *selfPlayThread(void *arg);
+
+/**
+ * @brief Plays many games between two policies and prints statistics.
+ * 
+ * The games are split between the threads, the results are added up when all threads are done.
+ * Prints the win rates, the distribution of the game lengths and the games per second.
+ * 
+ * @param start The starting position.
+ * @param options The command line options.
+ * @return true Returns true when all games were played.
+ * @return false Returns false when a thread could not be started or is out of memory.
+ */
+bool runSelfPlay(const Position *start, const Options *options);
+
+/**
+ * @brief Returns the time of a monotonic clock in milliseconds.
+ * 
+ * @return double Milliseconds since an unspecified point.
+ */
+double currentTime(void);
+
+/**
+ * @brief Allocates a transposition table.
+ * 
+ * The number of entries is the largest power of two that fits in the given megabytes.
+ * 
+ * @param table The table to set up.
+ * @param megabytes The memory budget.
+ * @return true Returns true when the memory was allocated.
+ * @return false Returns false when there is not enough memory.
+ */
+bool initTable(TranspositionTable *table, size_t megabytes);
+
+/**
+ * @brief Frees the entries of a transposition table.
+ * 
+ * @param table The table.
+ */
+void freeTable(TranspositionTable *table);
+
+/**
+ * @brief Looks up a position in the transposition table.
+ * 
+ * @param table The table.
+ * @param key The hash of the position and the side to move.
+ * @param score Receives the stored score.
+ * @param depth Receives the stored depth.
+ * @param bound Receives the stored Bound.
+ * @param move Receives the stored best move, NO_MOVE if there is none.
+ * @return true Returns true when the position was found.
+ * @return false Returns false when the position was not found.
+ */
+bool probeTable(const TranspositionTable *table, uint64_t key, int *score, int *depth, int *bound, Move *move);
+
+/**
+ * @brief Stores a searched position in the transposition table.
+ * 
+ * An entry of the current search is only replaced by a search that is at least as deep,
+ * or by a different position.
+ * 
+ * @param table The table.
+ * @param key The hash of the position and the side to move.
+ * @param score The score of the position.
+ * @param depth The depth it was searched to.
+ * @param bound The Bound of the score.
+ * @param move The best move found, NO_MOVE if there is none.
+ */
+void storeTable(TranspositionTable *table, uint64_t key, int score, int depth, int bound, Move move);
+
+/**
+ * @brief Returns the hash key of a position with the side to move.
+ * 
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return uint64_t The key used for the transposition table.
+ */
+uint64_t positionKey(const Position *pos, char player);
+
+/**
+ * @brief Returns the hash key of the canonical form of a position with the side to move.
+ * 
+ * The key is the smallest of the 8 hashes of the position, and rotations and reflections of the position
+ * have the same 8 hashes, so a table shares their entries.
+ * A move stored under the key has to be moved by the symmetry first, and back by its inverse.
+ * 
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param symmetry Receives the symmetry that takes the position to its canonical form.
+ * @return uint64_t The key, it is positionKey when the position is already canonical.
+ */
+uint64_t tableKey(const Position *pos, char player, int *symmetry);
+
+/**
+ * @brief Xors the keys of a piece on a square into the hashes of every symmetry.
+ * 
+ * @param pos The position.
+ * @param piece 0 for a musketeer, 1 for a soldier.
+ * @param square The square of the piece.
+ */
+void updateHashes(Position *pos, int piece, int square);
+
+/**
+ * @brief Counts the legal moves of a player without listing them.
+ * 
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return int The number of legal moves.
+ */
+int countMoves(const Position *pos, char player);
+
+/**
+ * @brief Scores a position that is not over.
+ * 
+ * Musketeers like to stand on different rows and collumns and to have many soldiers to capture.
+ * Soldiers like the opposite, and to have many moves of their own. With --weights the score is
+ * patternScore instead.
+ * 
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return int The score for the player to move, higher is better.
+ */
+int evaluate(const Position *pos, char player);
+
+/**
+ * @brief Finds the pattern table entries of a position.
+ * 
+ * A neighbour pattern for every musketeer(each of the 8 blocks around it empty, a soldier, or a musketeer
+ * or off the board), one alignment pattern of the rows and collumns of the musketeers, and the moves of
+ * both sides. Every feature is the index of its weight, all of them are found without branches.
+ * 
+ * @param musketeers The musketeers.
+ * @param soldiers The soldiers.
+ * @param features Receives PATTERN_FEATURES indexes into the weights.
+ */
+void patternFeatures(Bitboard musketeers, Bitboard soldiers, uint32_t features[PATTERN_FEATURES]);
+
+/**
+ * @brief The alignment pattern of the rows or the collumns of the musketeers.
+ * 
+ * @param lines The row or the collumn of every musketeer.
+ * @return int (most musketeers on one line - 1) * N + (last line - first line).
+ */
+int alignmentPattern(const int lines[MUSKETEERS]);
+
+/**
+ * @brief Scores a position with the pattern tables.
+ * 
+ * @param weights PATTERN_WEIGHTS weights.
+ * @param musketeers The musketeers.
+ * @param soldiers The soldiers.
+ * @return int The sum of the weights of the features, for the musketeers.
+ */
+int patternScore(const int16_t *weights, Bitboard musketeers, Bitboard soldiers);
+
+/**
+ * @brief Fills the pattern weights with the handwritten evaluation.
+ * 
+ * The neighbour weights are 0, the alignment weights give 16 for every row and collumn with a
+ * musketeer, and the move weights 4 for every musketeer move and -1 for every soldier move, so
+ * patternScore gives the same scores as evaluate() without weights(with more than three musketeers
+ * the rows and collumns are only estimated from the most on one line). The tuner starts from them.
+ * 
+ * @param weights Receives PATTERN_WEIGHTS weights.
+ */
+void defaultPatternWeights(int16_t *weights);
+
+/**
+ * @brief Loads a weights file for evaluate().
+ * 
+ * @param fileName The weights file.
+ * @return true Returns true when the weights are loaded into patternWeights.
+ * @return false Returns false when the file cannot be read or is for another board size.
+ */
+bool loadWeights(const char *fileName);
+
+/**
+ * @brief Writes a weights file: a header with WEIGHTS_MAGIC, N and PATTERN_WEIGHTS, then the weights.
+ * 
+ * @param fileName The weights file.
+ * @param weights PATTERN_WEIGHTS weights.
+ * @return true Returns true when the file was written.
+ * @return false Returns false on a file error.
+ */
+bool writeWeights(const char *fileName, const int16_t *weights);
+
+/**
+ * @brief Tunes the pattern weights on the outcomes of recorded games and writes them.
+ * 
+ * Every position of every finished game in --tune-games, in all 8 symmetries, is a sample whose
+ * result is 1 when the musketeers won. The weights minimise the cross-entropy of the predicted win
+ * chance with full-batch gradient descent(Adam): --threads threads add up the gradient of their share
+ * of the samples every epoch. They start from --weights, or else from the handwritten evaluation.
+ * 
+ * @param options The options, --tune gives the output file.
+ * @return true Returns true when the weights were written.
+ * @return false Returns false on a memory or file error, or when there are no samples.
+ */
+bool tuneWeights(const Options *options);
+
+/**
+ * @brief Adds up the gradient and the loss of a share of the tuning samples, in a thread.
+ * 
+ * @param arg The TuneWorker.
+ * @return void* NULL
+ */
+void *tuneThread(void *arg);
+
+/**
+ * @brief Sets up a search.
+ * 
+ * @param ctx The search to set up.
+ * @param table The transposition table the search uses.
+ * @param maxDepth The maximum depth of iterative deepening.
+ * @param timeLimit The time limit in milliseconds, 0 for no limit.
+ */
+void initSearch(SearchContext *ctx, TranspositionTable *table, int maxDepth, int timeLimit);
+
+/**
+ * @brief Searches a position with alpha-beta(negamax).
+ * 
+ * Looks up and stores positions in the transposition table and tries the table move,
+ * the killer moves and then the moves with the best history first.
+ * 
+ * @param ctx The search.
+ * @param pos The position, it is changed during the search and restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param depth The remaining depth.
+ * @param ply The distance from the root.
+ * @param alpha The lower bound of the window.
+ * @param beta The upper bound of the window.
+ * @return int The score for the player to move.
+ */
+int negamax(SearchContext *ctx, Position *pos, char player, int depth, int ply, int alpha, int beta);
+
+/**
+ * @brief Finds the best move with iterative deepening.
+ * 
+ * Searches depth 1, 2, ... up to the maximum depth or until the time is over, or only up to ctx->targetDepth
+ * when it is set. The result of the last finished depth is kept in ctx->bestMove and ctx->bestScore.
+ * 
+ * @param ctx The search, set up with initSearch.
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return Move The best move, NO_MOVE if the player has no legal move.
+ */
+Move searchBestMove(SearchContext *ctx, Position *pos, char player);
+
+/**
+ * @brief Starts pondering on the human's position in a new thread.
+ * 
+ * @param ponder The ponder state.
+ * @param table The transposition table of the game, nothing else may use it until stopPonder.
+ * @param pos The position, it is copied.
+ * @param player The human, who is to move.
+ * @param maxDepth Deepest iteration of the search.
+ */
+void startPonder(Ponder *ponder, TranspositionTable *table, const Position *pos, char player, int maxDepth);
+
+/**
+ * @brief The pondering thread, it searches until it is cancelled or the game is decided.
+ * 
+ * @param arg The Ponder.
+ * @return void* Always NULL.
+ */
+void *ponderThread(void *arg);
+
+/**
+ * @brief Cancels pondering and waits for the thread, the table is then free for the next search.
+ * 
+ * @param ponder The ponder state, nothing is done when it is not running.
+ */
+void stopPonder(Ponder *ponder);
+
+/**
+ * @brief Parses the next board of a mapped file.
+ * 
+ * A board is the next N*N characters that are not white space. Only 'M', 'o' and '.' are valid,
+ * and a legal board has exactly MUSKETEERS musketeers.
+ * 
+ * @param p The first character to read.
+ * @param end The end of the file.
+ * @param item Receives the position, or the error of an illegal board.
+ * @return const char* The character after the board, NULL when only white space is left.
+ */
+const char *parseBoard(const char *p, const char *end, BatchItem *item);
+
+/**
+ * @brief Analyses one board of the batch: winner and, when the game is not over, a search.
+ * 
+ * @param item The board.
+ * @param ctx The search of the calling thread.
+ * @param options The command line options(depth and time limit).
+ */
+void analyseBoard(BatchItem *item, SearchContext *ctx, const Options *options);
+
+/**
+ * @brief Analyses the boards of every block until the queue is finished.
+ * 
+ * @param arg The BatchWorker of the thread.
+ * @return void* Always NULL.
+ */
+void *batchThread(void *arg);
+
+/**
+ * @brief Finds the boards of a block that need no search of their own.
+ * 
+ * A board whose canonical form is in the cache takes the result from there. A board with the same
+ * canonical form as an earlier board of the block copies that board's result when the block is done.
+ * 
+ * @param queue The block, the symmetry and source of every board are set.
+ * @param cache The results of earlier blocks, BATCH_CACHE entries.
+ * @return long The boards that are not searched.
+ */
+long dedupeBlock(BatchQueue *queue, BatchCacheEntry *cache);
+
+/**
+ * @brief Adds the searched boards of a block to the cache and gives the other boards their results.
+ * 
+ * Best moves are stored in the canonical form and moved back to the board of every copy.
+ * 
+ * @param queue The analysed block.
+ * @param cache The cache.
+ */
+void finishBlock(BatchQueue *queue, BatchCacheEntry *cache);
+
+/**
+ * @brief Analyses the boards of many files with a thread pool.
+ * 
+ * Every input file is mapped with mmap and may hold any number of boards one after another.
+ * The boards are analysed a block at a time, and one line per board is written to the output file
+ * in input order. Boards that are rotations or reflections of a board seen before are not searched again.
+ * 
+ * @param options The command line options, with the input files and the output file.
+ * @return true Returns true when all files were analysed.
+ * @return false Returns false on a file, memory or thread error.
+ */
+bool runBatch(const Options *options);
+
+/**
+ * @brief Allocates the arrays of an evaluation batch.
+ * 
+ * @param batch The batch, its count is set to 0.
+ * @param capacity The most positions the batch holds.
+ * @return true Returns true when the arrays were allocated.
+ * @return false Returns false when there is not enough memory.
+ */
+bool initEvaluationBatch(EvaluationBatch *batch, size_t capacity);
+
+/**
+ * @brief Frees the arrays of an evaluation batch.
+ * 
+ * @param batch The batch.
+ */
+void freeEvaluationBatch(EvaluationBatch *batch);
+
+/**
+ * @brief Finds the winner, the move counts of both players and the score of every position of a batch.
+ * 
+ * The results are the same as getWinner, countMoves and evaluate give for one position. The AVX2
+ * kernel is used when the CPU has it, evaluateBatchScalar does the rest.
+ * 
+ * @param batch The batch.
+ */
+void evaluateBatch(EvaluationBatch *batch);
+
+/**
+ * @brief Evaluates part of a batch one position at a time, on the bitboards alone.
+ * 
+ * @param batch The batch.
+ * @param start The first position.
+ * @param end One past the last position.
+ */
+void evaluateBatchScalar(EvaluationBatch *batch, size_t start, size_t end);
+
+#ifdef HAVE_AVX2_EVALUATOR
+/**
+ * @brief Counts the set bits of every 32 bit lane.
+ * 
+ * @param squares Eight sets of squares.
+ * @return __m256i The eight counts.
+ */
+__attribute__((target("avx2"))) __m256i popcount8(__m256i squares);
+
+/**
+ * @brief Evaluates part of a batch eight positions at a time with AVX2.
+ * 
+ * @param batch The batch.
+ * @param count Positions to evaluate from the start, a multiple of 8.
+ */
+__attribute__((target("avx2"))) void evaluateBatchAvx2(EvaluationBatch *batch, size_t count);
+#endif
+
+/**
+ * @brief Counts the move paths of a given length.
+ * 
+ * Players alternate like in play(). A position with a winner has no moves, so paths end there.
+ * 
+ * @param pos The position, it is restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param depth The length of the paths.
+ * @param table A cache of subtree counts, NULL for none.
+ * @return uint64_t The number of paths.
+ */
+uint64_t perft(Position *pos, char player, int depth, PerftTable *table);
+
+/**
+ * @brief Counts the paths of the root moves handed out by a shared counter.
+ * 
+ * @param arg The PerftWorker of the thread.
+ * @return void* Always NULL.
+ */
+void *perftThread(void *arg);
+
+/**
+ * @brief Counts the move paths from the input board and prints the count and the speed.
+ * 
+ * The root moves are split over the threads. With divide the count of every root move is printed.
+ * 
+ * @param start The position of the input file, the musketeers move first.
+ * @param options The command line options.
+ * @return true Returns true when the count is done.
+ * @return false Returns false on a memory or thread error.
+ */
+bool runPerft(const Position *start, const Options *options);
+
+/**
+ * @brief Allocates the node arena of a Monte Carlo search tree.
+ * 
+ * @param tree The tree.
+ * @param megabytes The size of the arena.
+ * @return true Returns true when the arena was allocated.
+ * @return false Returns false when there is not enough memory.
+ */
+bool initMcts(MctsTree *tree, size_t megabytes);
+
+/**
+ * @brief Frees the node arena of a Monte Carlo search tree.
+ * 
+ * @param tree The tree.
+ */
+void freeMcts(MctsTree *tree);
+
+/**
+ * @brief Plays random moves until the game is over.
+ * 
+ * @param pos The position, it is changed.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param random The state of the random number generator.
+ * @return Winner The winner of the game.
+ */
+Winner randomPlayout(Position *pos, char player, uint64_t *random);
+
+/**
+ * @brief Runs playouts on a shared tree until the budget or the time is used.
+ * 
+ * Every playout walks down the tree with UCT, expands the leaf it reaches once it was visited,
+ * plays the rest of the game at random and adds the result to every node on its path.
+ * 
+ * @param arg The MctsWorker of the thread.
+ * @return void* Always NULL.
+ */
+void *mctsThread(void *arg);
+
+/**
+ * @brief Finds a move with parallel Monte Carlo tree search.
+ * 
+ * All threads work on the same tree(tree parallelization). The move of the root child
+ * with the most visits is played.
+ * 
+ * @param tree The tree, its arena is reused for every move.
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param options The command line options(threads, playouts and time limit).
+ * @param winRate Receives the share of playouts won through the chosen move.
+ * @return Move The best move, NO_MOVE if the player has no legal move.
+ */
+Move mctsBestMove(MctsTree *tree, Position *pos, char player, const Options *options, double *winRate);
+
+/**
+ * @brief Starts a game record.
+ * 
+ * @param record The record.
+ * @param start The starting position.
+ */
+void initRecord(GameRecord *record, const Position *start);
+
+/**
+ * @brief Adds a move to a game record.
+ * 
+ * @param record The record.
+ * @param move The move.
+ */
+void recordMove(GameRecord *record, Move move);
+
+/**
+ * @brief Encodes a game record in the record file format.
+ * 
+ * @param record The record.
+ * @param buffer Receives RECORD_HEADER_SIZE + moveCount bytes.
+ * @return size_t The number of bytes written.
+ */
+size_t encodeRecord(const GameRecord *record, uint8_t *buffer);
+
+/**
+ * @brief Appends a game record to a record file.
+ * 
+ * @param fileName The record file, it is created when it does not exist.
+ * @param record The record.
+ * @return true Returns true when the game was written.
+ * @return false Returns false when the file cannot be written.
+ */
+bool appendRecord(const char *fileName, const GameRecord *record);
+
+/**
+ * @brief Reads and checks the starting board of a record header.
+ * 
+ * The header comes from a file, so the boards are checked before setupPosition sees them: both must
+ * be inside FULL_MASK, must not overlap and the musketeers must be MUSKETEERS.
+ * 
+ * @param header RECORD_HEADER_SIZE bytes of a record file.
+ * @param start Receives the starting position when the boards are legal.
+ * @return true Returns true when the starting board is legal.
+ * @return false Returns false when it is not, start is not changed.
+ */
+bool decodeRecordStart(const uint8_t *header, Position *start);
+
+/**
+ * @brief Replays every game of a record file without display.
+ * 
+ * The file is mapped with mmap. Every move is checked with validateMove and played with makeMove,
+ * and the winner at the end is compared with the stored result. Prints the first errors and the speed.
+ * 
+ * @param fileName The record file.
+ * @return true Returns true when every game replays without error.
+ * @return false Returns false when the file cannot be read or a game is wrong.
+ */
+bool replayRecords(const char *fileName);
+
+/**
+ * @brief Plays a move script on a position without display or input.
+ * 
+ * The musketeers move first. Moves are in the input format and separated by white space, "0,0=E" ends
+ * the script early. Every move is checked with validateMove and played with makeMove; the script stops
+ * at the first move that fails.
+ * 
+ * @param start The starting position.
+ * @param script The moves, changed by strtok_r.
+ * @param result The outcome: the error, the plies played, the failing move and the winner.
+ * @return ScriptError SCRIPT_OK when every move was played, else the reason of the failing move.
+ */
+ScriptError playScript(const Position *start, char *script, ScriptResult *result);
+
+/**
+ * @brief Plays every move script of a file or pipe on the input board.
+ * 
+ * One script per line, empty lines and lines starting with '#' are skipped. Prints a line for every
+ * script, "Script S: ok, P plies, winner W" with W one of M, o or none, or
+ * "Script S, ply P (MOVE): REASON", and a summary with the speed at the end.
+ * 
+ * @param start The input board.
+ * @param fileName The script file, "-" for the standard input.
+ * @return true Returns true when every script played without error.
+ * @return false Returns false when the file cannot be read or a script fails.
+ */
+bool runScripts(const Position *start, const char *fileName);
+
+/**
+ * @brief Reads one game of a record file.
+ * 
+ * @param fileName The record file.
+ * @param game The number of the game, from 1.
+ * @param record Receives the game.
+ * @return true Returns true when the game was found.
+ * @return false Returns false when the file cannot be read, is damaged before the game or has fewer games.
+ */
+bool readRecord(const char *fileName, long game, GameRecord *record);
+
+/**
+ * @brief Searches positions of a game analysis until all are taken.
+ * 
+ * @param arg The GameAnalysis.
+ * @return void* Always NULL.
+ */
+void *analysisThread(void *arg);
+
+/**
+ * @brief Writes a score for the musketeers, a won game as the winner and the plies to the win.
+ * 
+ * @param score The score for the musketeers.
+ * @param str Receives the text.
+ */
+void scoreToString(int score, char str[24]);
+
+/**
+ * @brief Analyses every move of a recorded game and prints the annotated move list.
+ * 
+ * Every position of the game is searched to --depth without a time limit on --threads threads that
+ * share one transposition table. A move is best when it loses less than INACCURACY_LOSS against the
+ * best move, a blunder when it loses BLUNDER_LOSS or more or throws away a win, and an inaccuracy
+ * otherwise. The swing is the change of the score for the musketeers. The final board is written
+ * with writeBoard.
+ * 
+ * @param options The options, with the record file and the game number.
+ * @return true Returns true when the game was analysed.
+ * @return false Returns false on a file, memory or thread error, or an illegal move in the record.
+ */
+bool analyseGame(const Options *options);
+
+/**
+ * @brief Runs the game server until SIGINT or SIGTERM.
+ * 
+ * Listens on a Unix domain socket and plays every connection as one game from the start position,
+ * all in one epoll loop. The protocol is line based, the client sends moves in the input format
+ * ("A,5=L") or "0,0=E" to leave, and the server answers:
+ * 
+ *     READY <board> <player>   on connect, the board row by row and the player to move
+ *     OK <move>                the move was played
+ *     MOVE <move>              the computer played for a side given with --computer
+ *     ERROR <reason>           the move was not played
+ *     WIN M or WIN o           the game is over, the connection is closed
+ *     BYE                      answer to "0,0=E", the connection is closed
+ *     FULL                     every slot is in use, the connection is closed
+ * 
+ * Computer moves are searched by --threads threads that share one transposition table. The loop gives
+ * them the position and goes on serving the other games; a thread posts the move back through an
+ * eventfd, and the loop plays one computer move per result. Stopping waits for running searches.
+ * 
+ * @param start The start position of every game.
+ * @param options The options, --server, --server-games and the computer options.
+ * @return true Returns true when the server stopped on a signal.
+ * @return false Returns false when the socket or the pool cannot be set up.
+ */
+bool runServer(const Position *start, const Options *options);
+
+/**
+ * @brief Signal handler of the game server, asks the event loop to stop.
+ * 
+ * @param signal The signal number.
+ */
+void stopServer(int signal);
+
+/**
+ * @brief Accepts every pending connection and gives each a free slot.
+ * 
+ * @param server The server.
+ */
+void serverAccept(GameServer *server);
+
+/**
+ * @brief Reads from a client and answers every complete line.
+ * 
+ * @param server The server.
+ * @param index The slot of the client.
+ */
+void serverRead(GameServer *server, int index);
+
+/**
+ * @brief Answers one request line of a client.
+ * 
+ * @param server The server.
+ * @param slot The slot of the client.
+ * @param line The line, without the newline.
+ */
+void serverLine(GameServer *server, GameSlot *slot, char *line);
+
+/**
+ * @brief Ends the game when it is over, or gives the position to the search threads when the computer moves.
+ * 
+ * @param server The server.
+ * @param slot The slot of the game.
+ */
+void serverTurn(GameServer *server, GameSlot *slot);
+
+/**
+ * @brief A search thread of the server, it finds the moves of the jobs until the server stops.
+ * 
+ * @param arg The GameServer.
+ * @return void* NULL
+ */
+void *serverSearchThread(void *arg);
+
+/**
+ * @brief The record writer of the server, it appends the queued games to the record file until the server stops.
+ * 
+ * @param arg The GameServer.
+ * @return void* NULL
+ */
+void *serverRecordThread(void *arg);
+
+/**
+ * @brief Adds a finished game to the queue of the record writer, growing the queue when the writer is behind.
+ * 
+ * @param server The server.
+ * @param record The game.
+ */
+void serverQueueRecord(GameServer *server, const GameRecord *record);
+
+/**
+ * @brief Plays the moves the search threads found, one computer move for each.
+ * 
+ * @param server The server.
+ */
+void serverResults(GameServer *server);
+
+/**
+ * @brief Stops the search threads after their running searches and the record writer after the queued games,
+ * then closes the record file and frees the rings.
+ * 
+ * @param server The server.
+ */
+void stopServerThreads(GameServer *server);
+
+/**
+ * @brief Adds a reply line to the output of a slot.
+ * 
+ * A client that lets SLOT_OUTPUT bytes pile up is disconnected.
+ * 
+ * @param slot The slot.
+ * @param format The printf format of the line, without the newline.
+ */
+void serverReply(GameSlot *slot, const char *format, ...);
+
+/**
+ * @brief Sends the output of a slot, waits for EPOLLOUT when the socket is full and closes finished games.
+ * 
+ * @param server The server.
+ * @param index The slot.
+ */
+void serverFlush(GameServer *server, int index);
+
+/**
+ * @brief Closes a connection and returns its slot to the free list.
+ * 
+ * A slot whose move is being searched returns when the result comes back.
+ * 
+ * @param server The server.
+ * @param index The slot.
+ */
+void serverClose(GameServer *server, int index);
+
+/**
+ * @brief Allocates the table of a proof-number search.
+ * 
+ * @param ps The search.
+ * @param megabytes The memory budget of the table.
+ * @return true Returns true when the memory was allocated.
+ * @return false Returns false when there is not enough memory.
+ */
+bool initProofSearch(ProofSearch *ps, size_t megabytes);
+
+/**
+ * @brief Stores the numbers of a position, over the entry of the bucket with the least work when it is full.
+ * 
+ * @param ps The search.
+ * @param key The positionKey of the position.
+ * @param pn The proof number.
+ * @param dn The disproof number.
+ * @param work Nodes searched below the position.
+ */
+void storeProof(ProofSearch *ps, uint64_t key, uint32_t pn, uint32_t dn, uint64_t work);
+
+/**
+ * @brief Finds the numbers of the position after a move, for the player who moves next.
+ * 
+ * A won or lost position gets exact numbers from getWinner, or from soldiers that cannot move.
+ * A position that is not in the table counts as 1 and 1.
+ * 
+ * @param ps The search.
+ * @param pos The position before the move, it is restored before returning.
+ * @param player The player that makes the move.
+ * @param move The move.
+ * @param pn Receives the proof number.
+ * @param dn Receives the disproof number.
+ * @param work Receives the work of the table entry, 0 when there is none.
+ */
+void childNumbers(ProofSearch *ps, Position *pos, char player, Move move, uint32_t *pn, uint32_t *dn, uint64_t *work);
+
+/**
+ * @brief Depth-first proof-number search(df-pn) of a position that is not over.
+ * 
+ * Expands the child with the smallest disproof number until the proof number of the position reaches
+ * thresholdPn or its disproof number reaches thresholdDn, then stores the numbers in the table.
+ * 
+ * @param ps The search.
+ * @param pos The position, it is restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param thresholdPn The proof number limit.
+ * @param thresholdDn The disproof number limit.
+ */
+void proofSearch(ProofSearch *ps, Position *pos, char player, uint32_t thresholdPn, uint32_t thresholdDn);
+
+/**
+ * @brief Decides whether the side to move wins by force and prints the proving line.
+ * 
+ * Prints the root numbers, the nodes and the nodes per second every second while it runs.
+ * 
+ * @param start The position.
+ * @param options The options, --solve gives the side to move and --hash the table size.
+ * @return true Returns true when the position was solved.
+ * @return false Returns false when the table cannot be allocated.
+ */
+bool runSolve(const Position *start, const Options *options);
+
+/**
+ * @brief Searches root moves claimed from the shared memory until none is left, in a worker process.
+ * 
+ * @param shared The shared memory, the table follows the header.
+ * @param start The root position.
+ * @param player The side to move in the root position('M' - Musketeer, 'o' soldier).
+ */
+void solveWorker(SolveHeader *shared, const Position *start, char player);
+
+/**
+ * @brief Writes the shared memory of a solve to a checkpoint file.
+ * 
+ * The file is written under a temporary name, synced and renamed, so a crash while writing leaves the
+ * last checkpoint in place. Table entries written while it is copied fail their check and are ignored.
+ * 
+ * @param shared The shared memory.
+ * @param size The size of the shared memory.
+ * @param fileName The checkpoint file.
+ * @return true Returns true when the checkpoint was written.
+ * @return false Returns false on a file error.
+ */
+bool writeCheckpoint(const SolveHeader *shared, size_t size, const char *fileName);
+
+/**
+ * @brief Loads a checkpoint file into the shared memory of a solve.
+ * 
+ * Root moves that were being searched when the checkpoint was written are searched again.
+ * 
+ * @param shared The shared memory, with the header of this solve filled in.
+ * @param size The size of the shared memory.
+ * @param fileName The checkpoint file.
+ * @return int 1 when the checkpoint was loaded, 0 when the file does not exist, -1 when it belongs
+ *             to another solve or cannot be read.
+ */
+int loadCheckpoint(SolveHeader *shared, size_t size, const char *fileName);
+
+/**
+ * @brief Starts a worker process of a solve.
+ * 
+ * @param shared The shared memory.
+ * @param start The root position.
+ * @param player The side to move in the root position.
+ * @return pid_t The process id of the worker, -1 when fork fails.
+ */
+pid_t startSolveWorker(SolveHeader *shared, const Position *start, char player);
+
+/**
+ * @brief Solves a position with alpha-beta in several processes that share a transposition table.
+ * 
+ * The table lives in a shm_open segment. The root moves are split between --processes workers, each
+ * searches its moves to --depth - 1 without a time limit. A crashed worker is replaced and its move
+ * searched again; the table needs no repair, since a half written entry never matches a key. The
+ * segment is written to --checkpoint every --checkpoint-interval seconds and at the end, and a solve
+ * started with the same checkpoint, board, side, depth and table size continues from it.
+ * 
+ * @param start The position.
+ * @param options The options, --solve gives the side to move.
+ * @return true Returns true when every root move was searched.
+ * @return false Returns false on a memory, file or process error, or a root move that kept crashing.
+ */
+bool runParallelSolve(const Position *start, const Options *options);
+
+/**
+ * @brief Adds every position up to some plies from a position to a list, with the player to move.
+ * 
+ * Positions with a winner are left out. The list grows as needed and may hold duplicates.
+ * 
+ * @param pos The position, it is restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param plies Plies left to go.
+ * @param positions The list of positions.
+ * @param players The player to move of every listed position.
+ * @param count Number of listed positions.
+ * @param capacity Size of the list.
+ * @return true Returns true when the positions were listed.
+ * @return false Returns false when there is not enough memory.
+ */
+bool collectBookPositions(Position *pos, char player, int plies, Position **positions, char **players, long *count, long *capacity);
+
+/**
+ * @brief Searches the positions of one book builder thread.
+ * 
+ * @param arg The BookWorker.
+ * @return void* Always NULL.
+ */
+void *bookThread(void *arg);
+
+/**
+ * @brief Builds an opening book from the boards of the input files, the musketeers move first.
+ * 
+ * Every position up to --book-plies plies from a start position is searched to --depth without a
+ * time limit on --threads threads. The best moves are written sorted by key, so the book can be
+ * searched in place.
+ * 
+ * @param options The options, with the input files and the book file.
+ * @return true Returns true when the book was written.
+ * @return false Returns false on a file, memory or thread error.
+ */
+bool buildBook(const Options *options);
+
+/**
+ * @brief Maps an opening book file.
+ * 
+ * @param ob The book to fill.
+ * @param fileName The book file.
+ * @return true Returns true when the file is a book for this board size.
+ * @return false Returns false when the file cannot be read or does not match.
+ */
+bool loadBook(OpeningBook *ob, const char *fileName);
+
+/**
+ * @brief Looks the position up in the opening book with a binary search.
+ * 
+ * @param ob The book.
+ * @param pos The position.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param score Receives the score of the book move.
+ * @return Move The book move, NO_MOVE when the position is not in the book.
+ */
+Move bookMove(const OpeningBook *ob, const Position *pos, char player, int *score);
+
+/**
+ * @brief Reads the input files and lists the positions and move strings of the benchmark.
+ * 
+ * @param data The data to fill.
+ * @param options The options, with the input files.
+ * @return true Returns true when every input file holds legal boards.
+ * @return false Returns false on a file or memory error.
+ */
+bool initBench(BenchData *data, const Options *options);
+
+/**
+ * @brief Frees the positions, move strings, text and table of the benchmark.
+ * 
+ * @param data The benchmark data.
+ */
+void freeBench(BenchData *data);
+
+/**
+ * @brief Runs one pass over a workload.
+ * 
+ * The caller times whole repetitions, the time spent clearing the transposition table before
+ * every search is reported so it can be taken out.
+ * 
+ * @param data The benchmark data.
+ * @param workload The workload.
+ * @param excluded Milliseconds that are not part of the workload are added here.
+ * @return uint64_t The operations of the pass.
+ */
+uint64_t benchPass(BenchData *data, BenchWorkload workload, double *excluded);
+
+/**
+ * @brief Measures one workload: a warm-up, then the repetitions, each long enough to time reliably.
+ * 
+ * @param data The benchmark data.
+ * @param workload The workload.
+ * @param result Receives the passes, operations, samples and their statistics.
+ */
+void measureWorkload(BenchData *data, BenchWorkload workload, BenchResult *result);
+
+/**
+ * @brief Runs every benchmark workload, prints a table and writes the results as JSON.
+ * 
+ * @param options The options, with the input files, the JSON file, the depth and the repetitions.
+ * @return true Returns true when the benchmark ran and the JSON file was written.
+ * @return false Returns false on a file or memory error.
+ */
+bool runBench(const Options *options);
+
+#ifdef METRICS
+/**
+ * @brief Registers the metrics of the calling thread.
+ * 
+ * @return ThreadMetrics* The new metrics, or the spare ones when there is not enough memory.
+ */
+ThreadMetrics *registerMetrics(void);
+
+/**
+ * @brief Adds to a counter of the calling thread.
+ * 
+ * @param metric The counter.
+ * @param value The amount to add.
+ */
+void metricAdd(Metric metric, uint64_t value);
+
+/**
+ * @brief Adds the think time of one move to the histogram of the calling thread.
+ * 
+ * @param milliseconds The time the computer took for the move.
+ */
+void metricThinkTime(double milliseconds);
+
+/**
+ * @brief Sums the metrics of every thread.
+ * 
+ * @param total Receives the sums, the next pointer is not set.
+ * @return int The number of registered threads.
+ */
+int readMetrics(ThreadMetrics *total);
+
+/**
+ * @brief Writes the metrics to BASE.json and to BASE.prom in the Prometheus text format.
+ * 
+ * Each file is written under a temporary name and renamed, so a reader never sees half a file.
+ * 
+ * @param base The base name of the files.
+ * @return true Returns true when both files were written.
+ * @return false Returns false on a file error.
+ */
+bool writeMetrics(const char *base);
+
+/**
+ * @brief Writes the metrics files once more when the program exits, registered with atexit.
+ */
+void writeMetricsAtExit(void);
+
+/**
+ * @brief Writes the metrics files every time the process receives SIGUSR1.
+ * 
+ * @param arg Not used.
+ * @return void* Never returns.
+ */
+void *metricsThread(void *arg);
+
+/**
+ * @brief Starts writing the metrics on SIGUSR1 and on exit.
+ * 
+ * SIGUSR1 is blocked before any other thread starts, so only metricsThread receives it.
+ * 
+ * @param base The base name of the files.
+ * @return true Returns true when the metrics thread runs.
+ * @return false Returns false when it could not be started.
+ */
+bool startMetrics(const char *base);
+#endif
+
+/**
+ * @brief Applies a rotation or reflection to a set of squares.
+ * 
+ * @param squares The set of squares.
+ * @param symmetry The symmetry, 0 to SYMMETRIES-1.
+ * @return Bitboard The transformed set.
+ */
+Bitboard transformBoard(Bitboard squares, int symmetry);
+
+/**
+ * @brief Finds the canonical form of a position, the smallest of its rotations and reflections.
+ * 
+ * Forms are compared by the musketeers first, then by the soldiers.
+ * 
+ * @param musketeers The musketeers of the position.
+ * @param soldiers The soldiers of the position.
+ * @param canonicalMusketeers Receives the musketeers of the canonical form.
+ * @param canonicalSoldiers Receives the soldiers of the canonical form.
+ * @return int The symmetry that takes the position to the canonical form, the smallest one on a tie.
+ */
+int canonicalPosition(Bitboard musketeers, Bitboard soldiers, Bitboard *canonicalMusketeers, Bitboard *canonicalSoldiers);
+
+/**
+ * @brief Computes the Zobrist hash of a set of musketeers or soldiers a byte at a time.
+ * 
+ * @param squares The set of squares.
+ * @param piece 0 for musketeers, 1 for soldiers.
+ * @return uint64_t The xor of the keys of every square.
+ */
+uint64_t hashSquares(Bitboard squares, int piece);
+
+/**
+ * @brief Ranks a set of squares in the combinatorial number system.
+ * 
+ * The squares are numbered by their order inside space, so k squares out of a space of n squares
+ * get a rank from 0 to C(n, k) - 1.
+ * 
+ * @param squares The set, all squares must be inside space.
+ * @param space The squares that can be part of the set.
+ * @return uint64_t The rank of the set.
+ */
+uint64_t rankSquares(Bitboard squares, Bitboard space);
+
+/**
+ * @brief Fills the binomial table and the musketeer symmetry classes.
+ * 
+ * Must be called before a tablebase is built or loaded.
+ * 
+ * @return true Returns true when the tables were allocated.
+ * @return false Returns false when there is not enough memory.
+ */
+bool initTablebaseIndex(void);
+
+/**
+ * @brief Looks up a position in a tablebase.
+ * 
+ * The position is reduced by the symmetries of the board before it is ranked.
+ * 
+ * @param tb The tablebase.
+ * @param musketeers The musketeer squares.
+ * @param soldiers The soldier squares.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return uint8_t The value for the player to move, TB_NONE when the soldier count is not stored.
+ */
+uint8_t tablebaseValue(const Tablebase *tb, Bitboard musketeers, Bitboard soldiers, char player);
+
+/**
+ * @brief Computes the value of a position from the values of the positions after every move.
+ * 
+ * @param tb The tablebase, the layers of the next positions must be finished.
+ * @param pos The position, it is restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @return uint8_t The value for the player to move.
+ */
+uint8_t solveTablebasePosition(const Tablebase *tb, Position *pos, char player);
+
+/**
+ * @brief Builds the musketeer classes of one layer handed out by a shared counter.
+ * 
+ * @param arg The TablebaseWorker of the thread.
+ * @return void* Always NULL.
+ */
+void *tablebaseThread(void *arg);
+
+/**
+ * @brief Builds a tablebase file.
+ * 
+ * Soldiers are never added, so a position only depends on positions with fewer soldiers or,
+ * after a soldier move, on positions with the musketeers to move and the same soldiers.
+ * The layers are built in that order, from 0 soldiers up, and every layer is split over the threads.
+ * The values are written straight into the mapped file.
+ * 
+ * @param fileName The name of the tablebase file.
+ * @param maxSoldiers The largest soldier count to build.
+ * @param threads The number of threads.
+ * @return true Returns true when the file was written.
+ * @return false Returns false on a file or memory error.
+ */
+bool buildTablebase(const char *fileName, int maxSoldiers, int threads);
+
+/**
+ * @brief Maps a tablebase file into memory.
+ * 
+ * @param tb The tablebase to fill.
+ * @param fileName The name of the tablebase file.
+ * @return true Returns true when the file is a tablebase for this board.
+ * @return false Returns false when the file cannot be read or does not match.
+ */
+bool loadTablebase(Tablebase *tb, const char *fileName);
+
+/**
+ * @brief Picks the move of perfect play from a tablebase.
+ * 
+ * The winning side takes the quickest win, the losing side the slowest loss.
+ * 
+ * @param tb The tablebase.
+ * @param pos The position, it is restored before returning.
+ * @param player The player to move('M' - Musketeer, 'o' soldier).
+ * @param value Receives the value of the position.
+ * @return Move The best move, NO_MOVE if the position is not stored or the player cannot move.
+ */
+Move tablebaseBestMove(const Tablebase *tb, Position *pos, char player, uint8_t *value);
+
+/**
+ * @brief Reads the board from a file.
+ * 
+ * This function reads the board from a file, given by the user on the command line.
+ * It checks if the input file given by the user exists and holds a full board with MUSKETEERS musketeers.
+ * If any of the above is not correct, the function prints an error message and returns false, else returns true.
+ * 
+ * The characters are converted to a position with boardToPosition.
+ * 
+ * @param pos The position that represents the game board.
+ * @param fileName The name of the input file.
+*/
+bool readBoard(Position *pos, const char *fileName);
+
+/**
+ * @brief Displays the board in the console.
+ * 
+ * This function prints the current state of your board to the console.
+ * 
+ * @param pos The position that represents the game board.
+ */
+void displayBoard(const Position *pos);
+
+/**
+ * @brief Prints the collumn numbers above the board.
+ * 
+ * @param fp The console(stdout) or the output file.
+ */
+void printColumnNumbers(FILE *fp);
+
+/**
+ * @brief Prints the line between two rows of the board.
+ * 
+ * @param fp The console(stdout) or the output file.
+ */
+void printRowSeparator(FILE *fp);
+
+/**
+ * @brief Reads and chacks the player's move.
+ * 
+ * This function reads the players move, and checks it's format.
+ * While there is a mistake, a mistake message is printed and the user is asked to make a new move.
+ * 
+ * @param str A character array to store the players input.
+ * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
+ * @return false Returns false when player wants to exit the game.
+ * @return true Returns true when player does not want to exit the game.
+ */
+bool readInputMove(char *str, char player);
+
+/**
+ * @brief Checks if the destination block is correct.
+ * 
+ * Checks if the destination block for Musketeers is 'o' and if
+ * the destination block for the enemy is '.'.
+ * 
+ * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
+ * @param destinationBlock The character in the destination block.
+ * @return true Returns true when destination is valid.
+ * @return false Returns false when destination block is not valid.
+ */
+bool checkDestinationBlock(char player, char destinationBlock);
+
+/**
+ * @brief Check if the current block is valid.
+ * 
+ * Check if the block that is trying to by moved is a Musketeer, when musketeer makes a move,
+ * and check if it is a soldier, when the enemy makes a move.
+ * 
+ * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
+ * @param currentBlock The character in the current block.
+ * @return true Returns true when character in the current block is valid.
+ * @return false Returns false when character in the current block is not valid.
+ */
+bool checkCurrentBlock(char player, char currentBlock);
+
+/**
+ * @brief Checks if the move is in the board limit.
+ * 
+ * The function checks if the direction the user gives, takes the piece out of the board limits.
+ * 
+ * @param row The row character of the current piece.
+ * @param col The collumn character of the current piece.
+ * @param direction The direction character(U\u D\d R\r L\l).
+ * @return true Returns true if the move is within the board limits.
+ * @return false Returns false if the move is not within the board limits.
+ */
+bool checkBoardLimit(char row, char col, char direction);
+
+/**
+ * @brief Converts row input.
+ * 
+ * This function converts the row input to its integer equivalent to control the board.
+ * 
+ * @param row The row character.
+ * @return char The integer representation of the row character.
+ */
+char convertRowInput(char row);
+
+/**
+ * @brief Moves the player's piece on the board.
+ * 
+ * This function moves the player's piece on the board after checking if the move is valid.
+ * It calls the functions checkBoardLimit, readInputMove, checkCurrentBlock, checkDestinationBlock to check if the move is valid.
+ * If the move is not valid, it prints error message and asks for player make a move again, and repeats until given move is correct.
+ * When correct input is given, the destination blocks of Musketeers become 'M' and 'o' for soldiers. Their previous blocks, become empty('.').
+ * 
+ * @param input The players input move.
+ * @param pos The position that represents the game board.
+ * @param player The player that makes the move('M' - Musketeer, 'o' soldier).
+ * @return false Returns false, if player wants to exit the game - If readInputMove returns false, moveBoard returns false too, to exit the program in main.
+ * @return true Returns true, if player does not want to exit the game.
+ */
+bool moveBoard(char input[6], Position *pos, char player);
+
+/**
+ * @brief Check for winner in the game.
+ * 
+ * This function checks if there is a winner in the game.
+ * Checks if there is a line or a collumn with 3 musketeers to find if The soldiers of Richeliu won.
+ * Checks if Musketeers have no neighbour soldiers to move, to find if Musketeers won.
+ * If there is a winner, a message is printed. The check itself is done by getWinner.
+ * 
+ * @param pos The position that represents the game board.
+ * @return true Returns true if winner is found.
+ * @return false Returns false if winner if not found.
+ */
+bool checkForWinner(const Position *pos);
+
+/**
+ * @brief Starts the game.
+ * 
+ * This function, manages the game loop and player turns.
+ * Calls the readInputMove function to ask the player for input, the moveBoard function to 
+ * make changes to the board, and the checkForWinner function to determine whether loop is going to continue.
+ * When the computer plays a side, its moves come from searchBestMove instead of readInputMove.
+ * While the human types a move against the alpha-beta engine, the computer ponders on the position.
+ * 
+ * @param pos The position that represents the game board.
+ * @param options The command line options.
+ */
+void play(Position *pos, const Options *options);
+
+/**
+ * @brief Writes the current board state to a file.
+ * 
+ * After game is done, this function is called to save the final board to
+ * a file with name "out-input-file.txt" where input-file.txt is the file that user typed on the command line
+ * before the start of the game. The position is converted back to characters with positionToBoard.
+ * 
+ * @param pos The position that represents the game board.
+ * @param fileName The name of the input file.
+ * @return true 
+ * @return false 
+ */
+bool writeBoard(const Position *pos, const char *fileName);
+
+/**
+ * @brief The main function is the core of the program.
+ * 
+ * It initializes the game board, displays instructions to players and 
+ * manages the game loop. It checks for winners and saves the final board
+ * to a file.
+ * 
+ * @param argc Number of command-line arguements.
+ * @param argv Command-line arguements  -  name of input file.
+ * @return int 
+ */
+int main(int argc, char **argv) {
+
+    Position board;                        // Declare the board
+    Options options;                       // Declare the command line options
+
+    initBitboards();                       // Fill the row, collumn and neighbour masks.
+
+    if(!parseOptions(&options, argc, argv))  // Read the options - if they are not valid, exit the program.
+        exit(1);
+#ifdef METRICS
+    if(options.metricsFile != NULL && !startMetrics(options.metricsFile))
+        exit(1);
+#endif
+
+    if(options.buildTablebaseFile != NULL || options.tablebaseFile != NULL){
+        if(!initTablebaseIndex()){
+            printf("Not enough memory for the tablebase index\n");
+            exit(1);
+        }
+        if(options.buildTablebaseFile != NULL)
+            return buildTablebase(options.buildTablebaseFile, options.tablebaseSoldiers, options.threads) ? 0 : 1;
+        if(!loadTablebase(&tablebase, options.tablebaseFile))
+            exit(1);
+    }
+
+    if(options.weightsFile != NULL && !loadWeights(options.weightsFile))
+        exit(1);
+    if(options.tuneFile != NULL)             // The tuner reads its own games.
+        return tuneWeights(&options) ? 0 : 1;
+
+    if(options.buildBookFile != NULL)        // The book builder reads every input file.
+        return buildBook(&options) ? 0 : 1;
+    if(options.bookFile != NULL && !loadBook(&book, options.bookFile))
+        exit(1);
+
+    if(options.benchFile != NULL)            // So does the benchmark.
+        return runBench(&options) ? 0 : 1;
+
+    if(options.batchFile != NULL)            // The batch analysis reads its own files.
+        return runBatch(&options) ? 0 : 1;
+
+    if(options.replayFile != NULL)           // So does the replay.
+        return replayRecords(options.replayFile) ? 0 : 1;
+
+    if(options.analyseFile != NULL)          // And the analysis of a recorded game.
+        return analyseGame(&options) ? 0 : 1;
+
+    if(!readBoard(&board, options.boardFile)) // Call readBoard to read the board from a file specified in the command line arguements
+        exit(1);                             // - if it returns false, exit the program.
+
+    if(options.scriptFile != NULL)           // Scripts run without the board display and the input.
+        return runScripts(&board, options.scriptFile) ? 0 : 1;
+
+    if(options.selfPlayGames > 0)            // So does self-play.
+        return runSelfPlay(&board, &options) ? 0 : 1;
+
+    if(options.perftDepth > 0)               // So does perft.
+        return runPerft(&board, &options) ? 0 : 1;
+
+    if(options.solvePlayer != 0 && options.processes > 0)   // So do the solvers.
+        return runParallelSolve(&board, &options) ? 0 : 1;
+    if(options.solvePlayer != 0)
+        return runSolve(&board, &options) ? 0 : 1;
+
+    if(options.serverSocket != NULL)         // The server plays every game on its own socket.
+        return runServer(&board, &options) ? 0 : 1;
+
+    // Print game instructions
+    printf("***   The Three Musketeers Game   ***\n"
+    "To make a move, enter the location of the piece you want to move,\n"
+    "and the direction you want it to move. Locations are indicated as\n"
+    "a letter (A to %c) followed by a number (1 to %d).\n"
+    "Directions are indicated as left, right, up, down (L/l, R/r, U/u, D/d).\n"
+    "For example, to move the Musketeer from the top right-hand corner\n"
+    "to the row below, enter 'A,%d=L' or 'a,%d=l'(without quotes).\n"
+    "For convenience in typing, use lowercase letters.\n"
+    "Musketeers can move anywhere and soldiers can only move on empty blocks.\n\n", 'A'+N-1, N, N, N);
+
+    displayBoard(&board);                    // Display the initial board.
+
+    if(!checkForWinner(&board))              // Call checkForWinner - if it returns false, start the game loop.
+        play(&board, &options);              // Play prompts the players to move and update the board until a winner is determined.
+                                            
+
+    if(!writeBoard(&board, options.boardFile))             // Call writeBoard to save the final game board to an output file.
+        exit(1);                             // - if it returns false, exit the program.
+
+    return 0;
+}
+
+void initBitboards(void){
+    int i, byte, value, bit, square, t, direction, moved;
+    Bitboard to;
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;                   // Fixed seed, keys are the same in every run.
+    for(i = 0; i < 2*N*N + 1; i++){
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);         // splitmix64
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        if(i < 2*N*N)
+            zobristKeys[i / (N*N)][i % (N*N)] = z;
+        else zobristSide = z;
+    }
+
+    for(byte = 0; byte < SQUARE_BYTES; byte++)                // Every value of every byte, by its bits.
+        for(value = 0; value < 256; value++)
+            for(bit = 0; bit < 8 && 8*byte + bit < N*N; bit++)
+                if(value & (1 << bit)){
+                    square = 8*byte + bit;
+                    for(t = 0; t < SYMMETRIES; t++)
+                        symmetryBytes[t][byte][value] |= BIT(symmetrySquare[t][square]);
+                    zobristBytes[0][byte][value] ^= zobristKeys[0][square];
+                    zobristBytes[1][byte][value] ^= zobristKeys[1][square];
+                }
+    for(square = 0; square < N*N; square++)
+        for(t = 0; t < SYMMETRIES; t++){
+            symmetryKeys[0][square][t] = zobristKeys[0][symmetrySquare[t][square]];
+            symmetryKeys[1][square][t] = zobristKeys[1][symmetrySquare[t][square]];
+        }
+
+    for(value = 0; value < 512; value++)                      // Bit t of the window is block t, row by row.
+        for(i = 1, t = 0; t < 9; t++)
+            if(t != 4){                                       // The block of the musketeer itself.
+                patternIndex[value] += (value >> t & 1) * i;
+                i *= 3;
+            }
+    for(square = 0; square < N*N; square++)                   // The boards are shifted up by N + 1 first.
+        for(t = 0; t < 9; t++){
+            patternShifts[square][t / 3] = (square/N + t/3) * N + square%N;
+            if(square/N + t/3 - 1 < 0 || square/N + t/3 - 1 >= N || square%N + t%3 - 1 < 0 || square%N + t%3 - 1 >= N)
+                patternOffBoard[square] |= 1 << t;
+        }
+
+    memset(symmetryMoves, NO_MOVE, sizeof(symmetryMoves));
+    for(t = 0; t < SYMMETRIES; t++)
+        for(square = 0; square < N*N; square++)
+            for(direction = 0; direction < 4; direction++){
+                if(shiftBoard(BIT(square), direction) == 0)
+                    continue;                                 // Off the board, never a stored move.
+                to = BIT(symmetrySquare[t][square + directionOffset[direction]]);
+                for(moved = 0; shiftBoard(BIT(symmetrySquare[t][square]), moved) != to; moved++)
+                    ;
+                symmetryMoves[t][MOVE(square, direction)] = MOVE(symmetrySquare[t][square], moved);
+            }
+}
+
+uint64_t computeHash(const Position *pos){
+    uint64_t hash = 0;
+    Bitboard rest;
+
+    for(rest = pos->musketeers; rest; rest &= rest - 1)
+        hash ^= zobristKeys[0][FIRST_SQUARE(rest)];
+    for(rest = pos->soldiers; rest; rest &= rest - 1)
+        hash ^= zobristKeys[1][FIRST_SQUARE(rest)];
+    return hash;
+}
+
+char pieceAt(const Position *pos, int row, int col){
+    Bitboard square = BIT(row*N + col);
+
+    if(pos->musketeers & square)
+        return 'M';
+    if(pos->soldiers & square)
+        return 'o';
+    return '.';
+}
+
+bool boardToPosition(char board[N][N], Position *pos){
+    Bitboard musketeers = 0, soldiers = 0;
+    int i, j;
+
+    for(i = 0; i < N; i++)
+        for(j = 0; j < N; j++){
+            if(board[i][j] == 'M')
+                musketeers |= BIT(i*N + j);
+            else if(board[i][j] == 'o')
+                soldiers |= BIT(i*N + j);
+            else if(board[i][j] != '.')                       // Anything else is not a valid block.
+                return false;
+        }
+    setupPosition(pos, musketeers, soldiers);
+    return true;
+}
+
+void setupPosition(Position *pos, Bitboard musketeers, Bitboard soldiers){
+    Bitboard rest;
+
+    memset(pos, 0, sizeof(*pos));
+    for(rest = soldiers; rest; rest &= rest - 1)
+        addSoldier(pos, FIRST_SQUARE(rest));
+    for(rest = musketeers; rest; rest &= rest - 1)
+        addMusketeer(pos, FIRST_SQUARE(rest));
+}
+
+void addMusketeer(Position *pos, int square){
+    pos->musketeers |= BIT(square);
+    updateHashes(pos, 0, square);
+    pos->contacts += POPCOUNT(neighbourMask[square] & pos->soldiers);
+    pos->fullLines += ++pos->lineCount[square / N] == WIN_LINE;
+    pos->fullLines += ++pos->lineCount[N + square % N] == WIN_LINE;
+}
+
+void removeMusketeer(Position *pos, int square){
+    pos->musketeers &= ~BIT(square);
+    updateHashes(pos, 0, square);
+    pos->contacts -= POPCOUNT(neighbourMask[square] & pos->soldiers);
+    pos->fullLines -= pos->lineCount[square / N]-- == WIN_LINE;
+    pos->fullLines -= pos->lineCount[N + square % N]-- == WIN_LINE;
+}
+
+void addSoldier(Position *pos, int square){
+    pos->soldiers |= BIT(square);
+    updateHashes(pos, 1, square);
+    pos->contacts += POPCOUNT(neighbourMask[square] & pos->musketeers);
+}
+
+void removeSoldier(Position *pos, int square){
+    pos->soldiers &= ~BIT(square);
+    updateHashes(pos, 1, square);
+    pos->contacts -= POPCOUNT(neighbourMask[square] & pos->musketeers);
+}
+
+void positionToBoard(const Position *pos, char board[N][N]){
+    int i, j;
+
+    for(i = 0; i < N; i++)
+        for(j = 0; j < N; j++)
+            board[i][j] = pieceAt(pos, i, j);
+}
+
+bool readBoard(Position *pos, const char *fileName){
+    FILE *fp;                                                 // File pointer for output file.
+    char board[N][N];                                         // The board in the text format.
+    char *p = NULL;                                           // Pointer to go through the array
+
+    if((fp = fopen(fileName, "r")) == NULL){                   // If input is not found
+        printf("File not found\n");                           // print error message and return false.
+        return false;
+    }
+    for (p = &board[0][0]; p < &board[0][0] + N*N; p++)      // Read a character from file, and store it in the board.
+        if(fscanf(fp, " %c", p) != 1){                        // If the file ends early, print error message and return false.
+            printf("Board file is incomplete\n");
+            fclose(fp);
+            return false;
+        }
+    fclose(fp);
+    if(!boardToPosition(board, pos)){                         // Convert the characters to bitboards.
+        printf("Board file has an invalid block\n");
+        return false;
+    }
+    if(POPCOUNT(pos->musketeers) != MUSKETEERS){              // The search and the tablebase expect every musketeer.
+        printf("Board file must have %d musketeers\n", MUSKETEERS);
+        return false;
+    }
+    return true;
+}
+
+void displayBoard(const Position *pos){
+    int i, j;
+    printColumnNumbers(stdout);
+    for(i = 0; i < N; i++){
+        printRowSeparator(stdout);
+        printf("%c |", 'A'+i);
+        for(j = 0; j < N; j++){
+            printf(" %c |",pieceAt(pos, i, j));
+        }
+        printf("\n");
+    }
+    printRowSeparator(stdout);
+}
+
+void printColumnNumbers(FILE *fp){
+    int j;
+
+    fprintf(fp, "  ");
+    for(j = 0; j < N; j++)
+        fprintf(fp, "  %d ", j+1);
+    fprintf(fp, " \n");
+}
+
+void printRowSeparator(FILE *fp){
+    int j;
+
+    fprintf(fp, "  +");
+    for(j = 0; j < N; j++)
+        fprintf(fp, "---+");
+    fprintf(fp, "\n");
+}
+
+bool readInputMove(char *str, char player){
+
+    bool correctInput = false;                          // Boolean Variable turns true if input is correct.
+    
+    while(!correctInput){                               // Read Input until correct input is given by the user.
+
+        correctInput = true;
+
+        if(player == 'M')                               // Print Input message depending on the player.
+            printf("Give the Musketeer's move\n>");
+        else printf("Give the enemy's move \n>");                    
+        if(scanf("%s", str) != 1){                      // The input ended, leave the game like "0,0=E".
+            printf("\n");
+            return false;
+        }
+                                                                             // If input is "0,0=E" or "0,0=e" , return false.
+        if(*str == '0' && *(str+1) == ',' && *(str+2) == '0' && *(str+3) == '=' && (*(str+4) == 'E' || *(str+4) == 'e')){       
+            return false;
+        }
+        if(strlen(str)!=5){                                                  // If Wrong input length, correctInput=false, read again.
+            printf("Wrong Input Lenght.\n");
+            correctInput = false;
+        }
+        if((!(*str>='a' && *str<'a'+N) && !(*str>='A' && *str<'A'+N))){      // If Wrong row input, correctInput=false, read again.
+            printf("Wrong Row Input.\n");
+            correctInput = false;
+        }
+        if(*(str+1)!=','){                                                   // If Wrong input syntax, correctInput=false, read again.
+            printf("Wrong Input Syntax.\n");
+            correctInput = false;
+        }
+        if((*(str+2)<'1' || *(str+2)>='1'+N) ){                              // If Wrong collumn input, correctInput=false, read again.
+            printf("Wrong Collumn Input.\n");
+            correctInput = false;
+        }
+        if(*(str+3)!='='){                                                   // If Wrong input syntax, correctInput=false, read again.
+            printf("Wrong Input Syntax.\n");
+            correctInput = false;
+        }
+                                                                             // If Wrong direction input, correctInput=false, read again.
+        if(*(str+4)!='R' && *(str+4)!='r' && *(str+4)!='L' && *(str+4)!='l' && *(str+4)!='U' && *(str+4)!='u' && *(str+4)!='D' && *(str+4)!='d'){
+            printf("Wrong direction Input.\n");
+            correctInput = false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks if the destination block is correct.
+ * 
+ * Checks if the destination block for Musketeers is 'o' and if
+ * the destination block for the enemy is '.'.
+ * 
+ * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
+ * @param destinationBlock The character in the destination block.
+ * @return true Returns true when destination is valid.
+ * @return false Returns false when destination block is not valid.
+ */
+bool checkDestinationBlock(char player, char destinationBlock){
+
+    if(player == 'M')                                          // Check if player is a musketeer.         
+        if(destinationBlock != 'o'){                           // If musketeer's destination block is not a soldier print error message and return false.
+            printf("Destination Block is not a soldier\n"); 
+            METRIC_ADD(METRIC_REJECTED_DESTINATION_BLOCK, 1);
+            return false;
+        }
+    if(player == 'o')                                          // Check if player is a enemy.
+        if(destinationBlock != '.'){                           // If enemy's destination block is not an empty block, print error message and return false.
+            printf("Destination Block is not an empty block\n");
+            METRIC_ADD(METRIC_REJECTED_DESTINATION_BLOCK, 1);
+            return false;
+        }
+    return true;
+}
+
+bool checkCurrentBlock(char player, char currentBlock){
+    if(player == 'M')                                         // Check if player is a musketeer. 
+        if(currentBlock != 'M'){                              // If block that the musketeer is trying to move is not musketeer, print message and return false.
+            printf("Block that you are trying to move is not Musketeer\n");
+            METRIC_ADD(METRIC_REJECTED_CURRENT_BLOCK, 1);
+            return false;
+        }
+    if(player == 'o')                                         // Check if player is enemy.
+            if(currentBlock != 'o'){                          // If block that the enemy is trying to move is not a soldier, print message and return false.
+                printf("Block you are trying to move is not a soldier\n");
+                METRIC_ADD(METRIC_REJECTED_CURRENT_BLOCK, 1);
+                return false;
+            }
+    return true;
+}
+
+bool checkBoardLimit(char row, char col, char direction){           
+     if(((row == 'A' || row == 'a') && (direction == 'U' || direction == 'u'))    // If move is out of the board limit,
+      || ((row == 'A'+N-1 || row == 'a'+N-1) && (direction == 'D' || direction == 'd'))
+       || (col == '1' && (direction == 'L' || direction == 'l'))
+        || (col == '1'+N-1 && (direction == 'R' || direction == 'r'))){ 
+            printf("This move gets out of the board.\n");                         // Print error message and return false. 
+            METRIC_ADD(METRIC_REJECTED_BOARD_LIMIT, 1);
+            return false;     
+
+    }
+    else return true;
+}
+
+char convertRowInput(char row){
+    if(row >= 'A' && row < 'A'+N)                                              // Convert character to the integer equivalent to control the board
+            row = row-'A';
+        else row = row-'a';
+    return row;
+}
+
+bool moveBoard(char input[6], Position *pos, char player){                 
+    char row = input[0];                                                      
+    char col = input[2];
+    char direction = input [4];
+    int destinationRow, destinationCol;                                    // Coordinates of the destination block.
+    char destinationBlock;                                                 // Will be used in check methods
+    char currentBlock;                                                     // Will be used in check methods
+    Move move;                                                             // The checked move.
+
+    while(!checkBoardLimit(row, col, direction)){                          // Check if the move is not inside the board limit, and read again until it is.
+        if(!readInputMove(input, player))
+            return false; 
+        row = input[0];
+        col = input[2];
+        direction = input [4];
+    }
+
+    row = convertRowInput(row);                                            // Convert characters to integer to control the board.
+    currentBlock = pieceAt(pos, row, col-'1');                             // Declaring current block character.
+
+    destinationRow = row;                                                  // Depending on the direction, the method declares the destination block.
+    destinationCol = col-'1';
+    if(direction == 'r' || direction == 'R')
+        destinationCol++;
+    else if(direction == 'l' || direction == 'L')
+        destinationCol--;
+    else if(direction == 'u' || direction == 'U')
+        destinationRow--;
+    else if(direction == 'd' || direction == 'D')
+        destinationRow++;
+    destinationBlock = pieceAt(pos, destinationRow, destinationCol);
+    
+    // While current block or destination block don't meet the checks, input has to be given again.
+    while(!checkCurrentBlock(player, currentBlock) || !checkDestinationBlock(player, destinationBlock)){       
+
+        if(!readInputMove(input, player))                          // Read input and if player wants to exit the game return false, to exit the program in main.
+            return false;
+
+                row = input[0];
+                col = input[2];
+                direction = input [4];  
+                
+                while(!checkBoardLimit(row, col, direction)){      // While new move is not inside the board limit, read again.
+                    if(!readInputMove(input, player))
+                        return false;
+
+                    row = input[0];
+                    col = input[2];
+                    direction = input [4];
+                }
+                row = convertRowInput(row);                                  // Convert characters to integer to control the board.
+
+                currentBlock = pieceAt(pos, row, col-'1');                   // Declaring current block character.
+
+                destinationRow = row;                                        // Depending on the direction, the function declares the destination block.
+                destinationCol = col-'1';
+                if(direction == 'r' || direction == 'R')
+                    destinationCol++;
+                else if(direction == 'l' || direction == 'L')
+                    destinationCol--;
+                else if(direction == 'u' || direction == 'U')
+                    destinationRow--;
+                else if(direction == 'd' || direction == 'D')
+                    destinationRow++;
+                destinationBlock = pieceAt(pos, destinationRow, destinationCol);
+    }
+
+    // Depending on the direction that is given, changes will be made to the board.
+    if(destinationRow < row)
+        move = MOVE(row*N + col-'1', UP);
+    else if(destinationRow > row)
+        move = MOVE(row*N + col-'1', DOWN);
+    else if(destinationCol < col-'1')
+        move = MOVE(row*N + col-'1', LEFT);
+    else move = MOVE(row*N + col-'1', RIGHT);
+    METRIC_ADD(METRIC_MOVES_ACCEPTED, 1);
+    makeMove(pos, player, move);
+    displayBoard(pos);
+    return true;    // Return true if player does not want to exit the game.
+}
+
+Winner getWinner(const Position *pos){
+    METRIC_ADD(METRIC_WIN_CHECKS, 1);
+    if(pos->fullLines)                                                     // WIN_LINE musketeers on one row or collumn.
+        return SOLDIERS_WIN;
+    if(pos->contacts == 0)                                                 // No musketeer has a soldier to capture.
+        return MUSKETEERS_WIN;
+    return NO_WINNER;
+}
+
+int moveDestination(Move move){
+    return MOVE_FROM(move) + directionOffset[MOVE_DIRECTION(move)];
+}
+
+Bitboard shiftBoard(Bitboard squares, int direction){
+    if(direction == UP)
+        return squares >> N;
+    if(direction == DOWN)
+        return (squares << N) & FULL_MASK;
+    if(direction == LEFT)
+        return (squares & ~colMask[0]) >> 1;
+    return (squares & ~colMask[N-1]) << 1;
+}
+
+int generateMoves(const Position *pos, char player, Move moves[MAX_MOVES]){
+    Bitboard pieces, targets, reached;
+    int count = 0;
+    int direction, square;
+
+    if(player == 'M'){                                                     // Musketeers capture soldiers,
+        pieces = pos->musketeers;
+        targets = pos->soldiers;
+    }
+    else{                                                                  // soldiers move to empty blocks.
+        pieces = pos->soldiers;
+        targets = ~(pos->musketeers | pos->soldiers) & FULL_MASK;
+    }
+
+    for(direction = UP; direction <= RIGHT; direction++){
+        reached = shiftBoard(pieces, direction);                           // Shift all pieces one block in the direction.
+        for(reached &= targets; reached; reached &= reached - 1){          // Every reached target is one move.
+            square = FIRST_SQUARE(reached) - directionOffset[direction];
+            moves[count++] = MOVE(square, direction);
+        }
+    }
+    return count;
+}
+
+void makeMove(Position *pos, char player, Move move){
+    int from = MOVE_FROM(move);
+    int to = moveDestination(move);
+
+    if(player == 'M'){                                                     // The musketeer leaves its block and captures the soldier.
+        removeSoldier(pos, to);
+        removeMusketeer(pos, from);
+        addMusketeer(pos, to);
+    }
+    else{                                                                  // The soldier moves to the empty block.
+        removeSoldier(pos, from);
+        addSoldier(pos, to);
+    }
+}
+
+void unmakeMove(Position *pos, char player, Move move){
+    int from = MOVE_FROM(move);
+    int to = moveDestination(move);
+
+    if(player == 'M'){                                                     // The musketeer goes back and the soldier comes back.
+        removeMusketeer(pos, to);
+        addMusketeer(pos, from);
+        addSoldier(pos, to);
+    }
+    else{                                                                  // The soldier goes back to its block.
+        removeSoldier(pos, to);
+        addSoldier(pos, from);
+    }
+}
+
+MoveError validateMove(const Position *pos, char player, Move move){
+    Bitboard from = move < 4*N*N ? BIT(MOVE_FROM(move)) : 0;             // No square when the move is off the board.
+    Bitboard to = shiftBoard(from, MOVE_DIRECTION(move));
+    MoveError error = MOVE_OK;
+
+    if(to == 0)                                                            // checkBoardLimit
+        error = MOVE_OFF_BOARD;
+    else if(!(from & (player == 'M' ? pos->musketeers : pos->soldiers)))   // checkCurrentBlock
+        error = MOVE_WRONG_PIECE;
+    else if(player == 'M' ? !(to & pos->soldiers) : ((to & (pos->musketeers | pos->soldiers)) != 0))
+        error = MOVE_WRONG_DESTINATION;                                    // checkDestinationBlock
+    METRIC_ADD(METRIC_MOVES_ACCEPTED + error, 1);                         // The counters follow MoveError.
+    return error;
+}
+
+Move stringToMove(const char *str){
+    int row, col;
+    const char *directions = "UDLRudlr";
+    const char *direction;
+
+    if(strlen(str) != 5 || str[1] != ',' || str[3] != '=' || str[4] == '\0')
+        return NO_MOVE;
+    row = (str[0] >= 'a' ? str[0] - 'a' : str[0] - 'A');
+    col = str[2] - '1';
+    if(row < 0 || row >= N || col < 0 || col >= N || (direction = strchr(directions, str[4])) == NULL)
+        return NO_MOVE;
+    return MOVE(row*N + col, (direction - directions) % 4);
+}
+
+void moveToString(Move move, char str[6]){
+    str[0] = 'A' + MOVE_FROM(move) / N;
+    str[1] = ',';
+    str[2] = '1' + MOVE_FROM(move) % N;
+    str[3] = '=';
+    str[4] = "UDLR"[MOVE_DIRECTION(move)];
+    str[5] = '\0';
+}
+
+bool checkForWinner(const Position *pos){
+    Winner winner = getWinner(pos);
+
+    if(winner == SOLDIERS_WIN)                                             // If three musketeers are found on the same row or collumn
+        printf("Cardinal Richelieu's men win!\n");                         // Print winning message.
+    else if(winner == MUSKETEERS_WIN)                                      // If all 3 musketeers cannot move,
+        printf("The Musketeers win!\n");                                   // Print winning message of masketeers.
+    return winner != NO_WINNER;                                            // If a winner is found return true.
+}
+
+void play(Position *pos, const Options *options){
+    int n = 0;                                               // n is used to determine which player is playing
+    char player;
+    bool endOfGame = false;
+    bool computer = options->computerMusketeers || options->computerSoldiers;
+    TranspositionTable table;                                // Shared by all computer moves of the game.
+    MctsTree tree;
+    SearchContext ctx;
+    Move moves[MAX_MOVES];
+    Move move;
+    uint8_t value;
+    double winRate;
+    int score;
+    GameRecord record;
+    Ponder ponder;
+    bool pondering = computer && options->engine == ALPHA_BETA_ENGINE && options->ponder
+                     && !(options->computerMusketeers && options->computerSoldiers);
+    int ponderDepth = 0;                                     // Depth of the reply the ponder searched, 0 for none.
+
+    ponder.running = false;
+    initRecord(&record, pos);
+    if(computer && options->engine == MCTS_ENGINE && !initMcts(&tree, options->hashSize)){
+        printf("Not enough memory for the search tree\n");
+        return;
+    }
+    if(computer && options->engine == ALPHA_BETA_ENGINE && !initTable(&table, options->hashSize)){
+        printf("Not enough memory for the transposition table\n");
+        return;
+    }
+    
+    while(!endOfGame){
+        
+        if(n % 2 == 0)                                       // If n is even, Musketeer plays else the enemy
+            player = 'M';
+        else player = 'o';
+            
+        char str[6];
+
+        if(generateMoves(pos, player, moves) == 0){          // Soldiers that cannot move lose the game.
+            printf("Cardinal Richelieu's men cannot move. The Musketeers win!\n");
+            record.result = MUSKETEERS_WIN;
+            break;
+        }
+
+        computer = (player == 'M' && options->computerMusketeers) || (player == 'o' && options->computerSoldiers);
+        if(computer && tablebase.data != NULL && (move = tablebaseBestMove(&tablebase, pos, player, &value)) != NO_MOVE){
+            moveToString(move, str);                         // Perfect play from the tablebase.
+            printf("The computer plays %s (tablebase: %s in %d plies)\n", str, TB_IS_WIN(value) ? "win" : "loss", TB_PLIES(value));
+            makeMove(pos, player, move);
+            displayBoard(pos);
+        }
+        else if(computer && book.data != NULL && (move = bookMove(&book, pos, player, &score)) != NO_MOVE){
+            moveToString(move, str);                         // An opening move searched offline.
+            printf("The computer plays %s (book, score %d)\n", str, score);
+            makeMove(pos, player, move);
+            displayBoard(pos);
+        }
+        else if(computer && options->engine == MCTS_ENGINE){
+            move = mctsBestMove(&tree, pos, player, options, &winRate);
+            moveToString(move, str);
+            printf("The computer plays %s (mcts, %d playouts, %.1f%% won)\n", str, atomic_load(&tree.nodes[0].visits), 100.0 * winRate);
+            makeMove(pos, player, move);
+            displayBoard(pos);
+        }
+        else if(computer){
+            initSearch(&ctx, &table, options->depth, options->timeLimit);
+            ctx.targetDepth = ponderDepth;                   // After a ponder hit the table holds the answer.
+            move = searchBestMove(&ctx, pos, player);
+            moveToString(move, str);
+            printf("The computer plays %s (depth %d, score %d, %llu nodes%s)\n", str, ctx.completedDepth, ctx.bestScore,
+                   (unsigned long long)ctx.nodes, ponderDepth > 0 ? ", ponder hit" : "");
+            makeMove(pos, player, move);
+            displayBoard(pos);
+        }
+        else{
+            if(pondering)                                    // Search the replies while the human thinks.
+                startPonder(&ponder, &table, pos, player, options->depth);
+            if(!readInputMove(str, player) || !moveBoard(str, pos, player)){   // If player wants to exit return
+                stopPonder(&ponder);
+                break;
+            }
+            stopPonder(&ponder);
+            move = stringToMove(str);                        // moveBoard leaves the accepted move in str.
+            ponderDepth = 0;                                 // A hit when the human played the move the ponder expected,
+            if(pondering && move == ponder.ctx.bestMove)     // its last depth then searched the reply one ply less deep.
+                ponderDepth = ponder.ctx.completedDepth - 1;
+        }
+        recordMove(&record, move);
+
+        if(checkForWinner(pos) ==true){                      // If winner is found, end the game loop
+            endOfGame=true;
+            record.result = getWinner(pos);
+        }
+         n++;
+        }
+
+    if(options->recordFile != NULL && !appendRecord(options->recordFile, &record))
+        printf("Error writing the game record\n");
+
+    if((options->computerMusketeers || options->computerSoldiers) && options->engine == MCTS_ENGINE)
+        freeMcts(&tree);
+    else if(options->computerMusketeers || options->computerSoldiers)
+        freeTable(&table);
+}
+
+bool writeBoard(const Position *pos, const char *fileName){
+    FILE *fpout = NULL;                                           // File pointer for output file.
+    int i, j;                                                     // Loop counters.
+    char board[N][N];                                             // The board in the text format.
+    char str[100] = "out-";                                       // Initial part of output file.
+
+    strncat(str, fileName, sizeof(str) - strlen(str) - 1);        // Concatenate str and the input file name
+
+    if((fpout = fopen(str, "w")) == NULL){                        // If file open fails,
+        printf("Error opening file\n");                           // Print eror message and return false.
+        return false;                                               
+    }
+    positionToBoard(pos, board);                                  // Convert the bitboards to characters.
+    printColumnNumbers(fpout);
+    
+    for(i = 0; i < N; i++){
+        printRowSeparator(fpout);
+        fprintf(fpout, "%c |", 'A'+i);
+        for(j = 0; j < N; j++){
+            fprintf(fpout, " %c |",board[i][j]);
+        }
+        fprintf(fpout, "\n");
+    }
+
+    printRowSeparator(fpout);
+
+    fclose(fpout);                                               // Close the output file
+    printf("Saving %s...Done\nAu Revoir!\n", str);               // Print success message with filename
+    
+    return true;
+}
+
+
+
+bool parseOptions(Options *options, int argc, char **argv){
+    int i;
+
+    options->boardFile = NULL;
+    options->computerMusketeers = false;
+    options->computerSoldiers = false;
+    options->depth = -1;                                          // Set after the loop, the default depends on the mode.
+    options->timeLimit = DEFAULT_TIME_LIMIT;
+    options->hashSize = DEFAULT_HASH_SIZE;
+    options->selfPlayGames = 0;
+    options->threads = 1;
+    options->musketeerPolicy = RANDOM_POLICY;
+    options->soldierPolicy = RANDOM_POLICY;
+    options->seedGiven = false;
+    options->tablebaseFile = NULL;
+    options->buildTablebaseFile = NULL;
+    options->tablebaseSoldiers = DEFAULT_TABLEBASE_SOLDIERS;
+    options->inputCount = 0;
+    options->batchFile = NULL;
+    options->perftDepth = 0;
+    options->divide = false;
+    options->perftHashSize = 0;
+    options->engine = ALPHA_BETA_ENGINE;
+    options->playouts = DEFAULT_PLAYOUTS;
+    options->recordFile = NULL;
+    options->replayFile = NULL;
+    options->scriptFile = NULL;
+    options->analyseFile = NULL;
+    options->analyseGame = 1;
+    options->staticBatch = false;
+    options->ponder = true;
+    options->bookFile = NULL;
+    options->weightsFile = NULL;
+    options->tuneFile = NULL;
+    options->tuneGamesFile = NULL;
+    options->tuneEpochs = DEFAULT_TUNE_EPOCHS;
+    options->buildBookFile = NULL;
+    options->bookPlies = DEFAULT_BOOK_PLIES;
+    options->metricsFile = NULL;
+    options->benchFile = NULL;
+    options->benchRepetitions = DEFAULT_BENCH_REPETITIONS;
+    options->solvePlayer = 0;
+    options->processes = 0;
+    options->checkpointFile = NULL;
+    options->checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    options->serverSocket = NULL;
+    options->serverGames = DEFAULT_SERVER_GAMES;
+    if((options->inputFiles = malloc(argc * sizeof(char *))) == NULL)
+        return false;
+
+    for(i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--", 2) != 0){                       // Not an option, it is an input file.
+            options->boardFile = argv[i];
+            options->inputFiles[options->inputCount++] = argv[i];
+            continue;
+        }
+        if(i + 1 >= argc){                                        // Every option is followed by a value.
+            printf("Missing value for %s\n", argv[i]);
+            printUsage();
+            return false;
+        }
+        if(strcmp(argv[i], "--computer") == 0){
+            options->computerMusketeers = strchr(argv[i+1], 'M') != NULL;
+            options->computerSoldiers = strchr(argv[i+1], 'o') != NULL;
+        }
+        else if(strcmp(argv[i], "--depth") == 0)
+            options->depth = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--time") == 0)
+            options->timeLimit = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--hash") == 0)
+            options->hashSize = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--tablebase") == 0)
+            options->tablebaseFile = argv[i+1];
+        else if(strcmp(argv[i], "--build-tablebase") == 0)
+            options->buildTablebaseFile = argv[i+1];
+        else if(strcmp(argv[i], "--tablebase-soldiers") == 0)
+            options->tablebaseSoldiers = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--evaluate") == 0){
+            options->batchFile = argv[i+1];
+            options->staticBatch = argv[i][2] == 'e';
+        }
+        else if(strcmp(argv[i], "--perft") == 0 || strcmp(argv[i], "--divide") == 0){
+            options->perftDepth = atoi(argv[i+1]);
+            options->divide = argv[i][2] == 'd';
+        }
+        else if(strcmp(argv[i], "--perft-hash") == 0)
+            options->perftHashSize = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--engine") == 0){
+            if(strcmp(argv[i+1], "alphabeta") == 0)
+                options->engine = ALPHA_BETA_ENGINE;
+            else if(strcmp(argv[i+1], "mcts") == 0)
+                options->engine = MCTS_ENGINE;
+            else{
+                printf("Unknown engine %s\n", argv[i+1]);
+                printUsage();
+                return false;
+            }
+        }
+        else if(strcmp(argv[i], "--playouts") == 0)
+            options->playouts = atol(argv[i+1]);
+        else if(strcmp(argv[i], "--record") == 0)
+            options->recordFile = argv[i+1];
+        else if(strcmp(argv[i], "--replay") == 0)
+            options->replayFile = argv[i+1];
+        else if(strcmp(argv[i], "--script") == 0)
+            options->scriptFile = argv[i+1];
+        else if(strcmp(argv[i], "--analyse") == 0)
+            options->analyseFile = argv[i+1];
+        else if(strcmp(argv[i], "--game") == 0)
+            options->analyseGame = atol(argv[i+1]);
+        else if(strcmp(argv[i], "--ponder") == 0){
+            if(strcmp(argv[i+1], "on") != 0 && strcmp(argv[i+1], "off") != 0){
+                printf("Ponder must be on or off\n");
+                printUsage();
+                return false;
+            }
+            options->ponder = strcmp(argv[i+1], "on") == 0;
+        }
+        else if(strcmp(argv[i], "--book") == 0)
+            options->bookFile = argv[i+1];
+        else if(strcmp(argv[i], "--weights") == 0)
+            options->weightsFile = argv[i+1];
+        else if(strcmp(argv[i], "--tune") == 0)
+            options->tuneFile = argv[i+1];
+        else if(strcmp(argv[i], "--tune-games") == 0)
+            options->tuneGamesFile = argv[i+1];
+        else if(strcmp(argv[i], "--tune-epochs") == 0)
+            options->tuneEpochs = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--build-book") == 0)
+            options->buildBookFile = argv[i+1];
+        else if(strcmp(argv[i], "--book-plies") == 0)
+            options->bookPlies = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--metrics") == 0){
+#ifdef METRICS
+            options->metricsFile = argv[i+1];
+#else
+            printf("Metrics are not compiled in, build with -DMETRICS\n");
+            return false;
+#endif
+        }
+        else if(strcmp(argv[i], "--bench") == 0)
+            options->benchFile = argv[i+1];
+        else if(strcmp(argv[i], "--bench-repetitions") == 0)
+            options->benchRepetitions = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--solve") == 0){
+            if(strcmp(argv[i+1], "M") != 0 && strcmp(argv[i+1], "o") != 0){
+                printf("The side to move must be M or o\n");
+                printUsage();
+                return false;
+            }
+            options->solvePlayer = argv[i+1][0];
+        }
+        else if(strcmp(argv[i], "--processes") == 0)
+            options->processes = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--checkpoint") == 0)
+            options->checkpointFile = argv[i+1];
+        else if(strcmp(argv[i], "--checkpoint-interval") == 0)
+            options->checkpointInterval = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--server") == 0)
+            options->serverSocket = argv[i+1];
+        else if(strcmp(argv[i], "--server-games") == 0)
+            options->serverGames = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--selfplay") == 0)
+            options->selfPlayGames = atol(argv[i+1]);
+        else if(strcmp(argv[i], "--threads") == 0)
+            options->threads = atoi(argv[i+1]);
+        else if(strcmp(argv[i], "--seed") == 0){
+            options->seed = strtoull(argv[i+1], NULL, 10);
+            options->seedGiven = true;
+        }
+        else if(strcmp(argv[i], "--musketeer-policy") == 0 || strcmp(argv[i], "--soldier-policy") == 0){
+            if(!parsePolicy(argv[i+1], argv[i][2] == 'm' ? &options->musketeerPolicy : &options->soldierPolicy)){
+                printf("Unknown policy %s\n", argv[i+1]);
+                printUsage();
+                return false;
+            }
+        }
+        else{
+            printf("Unknown option %s\n", argv[i]);
+            printUsage();
+            return false;
+        }
+        i++;                                                      // Skip the value.
+    }
+
+    if(options->boardFile == NULL && options->buildTablebaseFile == NULL && options->replayFile == NULL
+       && options->analyseFile == NULL && options->tuneFile == NULL){   // If the input file is missing
+        printf("Wrong number of arguments\n");                    // print error message and return false.
+        printUsage();
+        return false;
+    }
+    if(options->depth == -1)
+        options->depth = options->batchFile != NULL ? DEFAULT_BATCH_DEPTH
+                       : options->buildBookFile != NULL ? DEFAULT_BOOK_DEPTH
+                       : options->benchFile != NULL ? DEFAULT_BENCH_DEPTH
+                       : options->analyseFile != NULL ? DEFAULT_ANALYSIS_DEPTH
+                       : options->selfPlayGames > 0 ? DEFAULT_SELF_PLAY_DEPTH : MAX_PLY - 1;
+    if(options->depth < 1 || options->depth >= MAX_PLY || options->timeLimit < 0 || options->hashSize < 1
+       || options->selfPlayGames < 0 || options->threads < 1 || options->perftDepth < 0 || options->perftHashSize < 0
+       || options->playouts < 0 || options->serverGames < 1 || options->bookPlies < 0 || options->bookPlies > MAX_PLY
+       || options->benchRepetitions < 2 || options->analyseGame < 1 || options->processes < 0
+       || options->checkpointInterval < 1 || options->tuneEpochs < 1
+       || options->tablebaseSoldiers < 0 || options->tablebaseSoldiers > N*N - MUSKETEERS){
+        printf("Option value out of range\n");
+        printUsage();
+        return false;
+    }
+    if(options->tuneFile != NULL && options->tuneGamesFile == NULL){
+        printf("--tune needs the games of --tune-games\n");
+        return false;
+    }
+    if(options->engine == MCTS_ENGINE && options->playouts == 0 && options->timeLimit == 0){
+        printf("The MCTS engine needs a --playouts or a --time limit\n");   // Otherwise it would never stop.
+        return false;
+    }
+    return true;
+}
+
+void printUsage(void){
+    printf("./nameOfExecutable [options] nameOfInputFile...\n"
+    "  --computer SIDES  the computer plays M, o or Mo\n"
+    "  --depth D         maximum search depth (1 to %d)\n"
+    "  --time MS         milliseconds per computer move, 0 for no limit (default %d)\n"
+    "  --hash MB         transposition table size in megabytes (default %d)\n"
+    "  --engine E        computer engine: alphabeta or mcts (default alphabeta)\n"
+    "  --playouts P      MCTS playouts per move, 0 for no limit, then --time must not be 0\n"
+    "                    (default %d)\n"
+    "  --ponder on|off   search while the human thinks, alphabeta only (default on)\n"
+    "  --selfplay G      play G games without display or input and print statistics\n"
+    "  --threads T       worker threads, also used by the MCTS engine (default 1)\n"
+    "  --musketeer-policy P, --soldier-policy P\n"
+    "                    self-play policy: random, greedy or search (default random,\n"
+    "                    search uses depth %d)\n"
+    "  --seed S          seed of the self-play policies, the same seed and --threads\n"
+    "                    play the same games (default the current time)\n"
+    "  --batch OUT       analyse every board of every input file into OUT\n"
+    "                    (default depth %d, uses --threads)\n"
+    "  --evaluate OUT    the same without search: winner, move counts and score\n"
+    "  --perft D         count the move paths of length D from the input board\n"
+    "  --divide D        the same, with the count of every first move\n"
+    "  --perft-hash MB   cache subtree counts in a table of MB megabytes\n"
+    "  --solve SIDE      prove whether SIDE(M or o), to move on the input board, wins by force\n"
+    "  --processes K     solve with alpha-beta in K processes sharing the table(--hash) in\n"
+    "                    shared memory, a crashed process is replaced\n"
+    "  --checkpoint FILE save the multi-process solve to FILE and continue from it\n"
+    "  --checkpoint-interval S\n"
+    "                    seconds between checkpoints (default %d)\n"
+    "  --record FILE     append every game to a record file\n"
+    "  --replay FILE     check and replay every game of a record file\n"
+    "  --script FILE     play the move scripts of FILE(- for the standard input) on the input\n"
+    "                    board without display, one game per line, and report every script\n"
+    "  --analyse FILE    search every position of a recorded game and mark every move\n"
+    "                    (default depth %d, uses --threads and --hash)\n"
+    "  --game G          the game of the record file to analyse (default 1)\n"
+    "  --server PATH     serve games on a Unix domain socket, one game per connection\n"
+    "  --server-games G  games the server plays at once (default %d), the computer\n"
+    "                    moves are searched by --threads threads\n"
+    "  --metrics BASE    write counters and think times to BASE.json and BASE.prom on exit\n"
+    "                    and on SIGUSR1(needs a build with -DMETRICS)\n"
+    "  --bench OUT       time parsing, win checks, moves, move generation, evaluation\n"
+    "                    and search on the input boards, write the results as JSON to OUT\n"
+    "                    (default depth %d)\n"
+    "  --bench-repetitions R\n"
+    "                    measured repetitions of every benchmark workload (default %d)\n"
+    "  --book FILE       play the moves of an opening book file first\n"
+    "  --build-book FILE build an opening book from the input boards\n"
+    "                    (default depth %d, uses --threads)\n"
+    "  --book-plies P    plies from the input boards the book covers (default %d)\n"
+    "  --tablebase FILE  look positions up in a tablebase file\n"
+    "  --build-tablebase FILE\n"
+    "                    build a tablebase file, no input file is needed\n"
+    "  --tablebase-soldiers S\n"
+    "                    largest soldier count of the tablebase (default %d)\n"
+    "  --weights FILE    evaluate positions with the pattern tables of a weights file\n"
+    "  --tune FILE       tune pattern weights on recorded games and write them to FILE\n"
+    "                    (uses --threads, starts from --weights when given)\n"
+    "  --tune-games FILE record file of the games to learn from\n"
+    "  --tune-epochs E   gradient descent steps of the tuner (default %d)\n",
+    MAX_PLY - 1, DEFAULT_TIME_LIMIT, DEFAULT_HASH_SIZE, DEFAULT_PLAYOUTS, DEFAULT_SELF_PLAY_DEPTH, DEFAULT_BATCH_DEPTH,
+    DEFAULT_CHECKPOINT_INTERVAL, DEFAULT_ANALYSIS_DEPTH, DEFAULT_SERVER_GAMES,
+    DEFAULT_BENCH_DEPTH, DEFAULT_BENCH_REPETITIONS, DEFAULT_BOOK_DEPTH, DEFAULT_BOOK_PLIES, DEFAULT_TABLEBASE_SOLDIERS,
+    DEFAULT_TUNE_EPOCHS);
+}
+
+bool parsePolicy(const char *name, Policy *policy){
+    if(strcmp(name, "random") == 0)
+        *policy = RANDOM_POLICY;
+    else if(strcmp(name, "greedy") == 0)
+        *policy = GREEDY_POLICY;
+    else if(strcmp(name, "search") == 0)
+        *policy = SEARCH_POLICY;
+    else return false;
+    return true;
+}
+
+double currentTime(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+bool initTable(TranspositionTable *table, size_t megabytes){
+    size_t count = 1;
+
+    while(count * 2 * sizeof(TableEntry) <= megabytes * 1024 * 1024)   // Largest power of two that fits.
+        count *= 2;
+    if((table->entries = calloc(count, sizeof(TableEntry))) == NULL)
+        return false;
+    table->mask = count - 1;
+    table->generation = 0;
+    return true;
+}
+
+void freeTable(TranspositionTable *table){
+    free(table->entries);
+    table->entries = NULL;
+}
+
+bool probeTable(const TranspositionTable *table, uint64_t key, int *score, int *depth, int *bound, Move *move){
+    const TableEntry *entry = &table->entries[key & table->mask];
+    uint64_t data = entry->data;
+
+    METRIC_ADD(METRIC_TABLE_PROBES, 1);
+    if((entry->check ^ data) != key)                              // Another position or a torn write.
+        return false;
+    METRIC_ADD(METRIC_TABLE_HITS, 1);
+    *score = (int16_t)(data & 0xFFFF);
+    *depth = (data >> 16) & 0xFF;
+    *bound = (data >> 24) & 0x3;
+    *move = (data >> 32) & 0xFF;
+    return true;
+}
+
+void storeTable(TranspositionTable *table, uint64_t key, int score, int depth, int bound, Move move){
+    TableEntry *entry = &table->entries[key & table->mask];
+    uint64_t old = entry->data;
+    bool samePosition = (entry->check ^ old) == key;
+    uint64_t data;
+
+    // Keep a deeper entry of the current search for the same slot.
+    if(!samePosition && ((old >> 40) & 0xFF) == table->generation && (int)((old >> 16) & 0xFF) > depth)
+        return;
+    if(samePosition && move == NO_MOVE)                           // Keep the old best move.
+        move = (old >> 32) & 0xFF;
+
+    data = (uint64_t)(uint16_t)score | (uint64_t)depth << 16 | (uint64_t)bound << 24
+         | (uint64_t)move << 32 | (uint64_t)table->generation << 40;
+    entry->check = key ^ data;
+    entry->data = data;
+}
+
+uint64_t positionKey(const Position *pos, char player){
+    return player == 'M' ? pos->hashes[0] : pos->hashes[0] ^ zobristSide;
+}
+
+uint64_t tableKey(const Position *pos, char player, int *symmetry){
+    uint64_t hash = pos->hashes[0];
+    int t;
+
+    *symmetry = 0;
+    for(t = 1; t < SYMMETRIES; t++)                               // The same 8 hashes in another order for every symmetric position.
+        if(pos->hashes[t] < hash){
+            hash = pos->hashes[t];
+            *symmetry = t;
+        }
+    return player == 'M' ? hash : hash ^ zobristSide;
+}
+
+void updateHashes(Position *pos, int piece, int square){
+    int t;
+
+    for(t = 0; t < SYMMETRIES; t++)
+        pos->hashes[t] ^= symmetryKeys[piece][square][t];
+}
+
+int countMoves(const Position *pos, char player){
+    Bitboard pieces, targets;
+    int direction, count = 0;
+
+    if(player == 'M'){
+        pieces = pos->musketeers;
+        targets = pos->soldiers;
+    }
+    else{
+        pieces = pos->soldiers;
+        targets = ~(pos->musketeers | pos->soldiers) & FULL_MASK;
+    }
+    for(direction = UP; direction <= RIGHT; direction++)
+        count += POPCOUNT(shiftBoard(pieces, direction) & targets);
+    return count;
+}
+
+int evaluate(const Position *pos, char player){
+    Bitboard musketeers = pos->musketeers;
+    Bitboard cols = 0;                                            // Collumns with a musketeer, as the bits of row 0.
+    int rows = 0;                                                 // Rows with a musketeer.
+    int i, score;
+
+    if(patternWeights != NULL){                                   // The tables of --weights.
+        score = patternScore(patternWeights, pos->musketeers, pos->soldiers);
+        return player == 'M' ? score : -score;
+    }
+    for(i = 0; i < N; i++){
+        rows += (musketeers & rowMask[i]) != 0;
+        cols |= musketeers >> (i*N);
+    }
+    cols &= rowMask[0];
+
+    // Score for the musketeers: spread over rows and collumns, captures available, few soldier moves.
+    score = 16 * (rows + POPCOUNT(cols)) + 4 * countMoves(pos, 'M') - countMoves(pos, 'o');
+    return player == 'M' ? score : -score;
+}
+
+void initSearch(SearchContext *ctx, TranspositionTable *table, int maxDepth, int timeLimit){
+    memset(ctx, 0, sizeof(*ctx));
+    memset(ctx->killers, NO_MOVE, sizeof(ctx->killers));
+    ctx->table = table;
+    ctx->maxDepth = maxDepth;
+    ctx->timeLimit = timeLimit;
+    ctx->rootMove = NO_MOVE;
+    ctx->bestMove = NO_MOVE;
+}
+
+int negamax(SearchContext *ctx, Position *pos, char player, int depth, int ply, int alpha, int beta){
+    Move moves[MAX_MOVES];
+    int order[MAX_MOVES];                                         // Ordering score of every move.
+    Move tableMove = NO_MOVE, bestMove = NO_MOVE, move;
+    int side = player == 'M' ? 0 : 1;
+    char opponent = player == 'M' ? 'o' : 'M';
+    int originalAlpha = alpha;
+    int count, i, j, best, score, bestScore = -INFINITE_SCORE;
+    int tableScore, tableDepth, tableBound, symmetry;
+    uint64_t key;
+    uint8_t value;
+    Winner winner;
+
+    ctx->nodes++;
+    if((ctx->nodes & 1023) == 0 && ((ctx->timeLimit > 0 && currentTime() - ctx->startTime >= ctx->timeLimit)
+       || (ctx->cancel != NULL && atomic_load_explicit(ctx->cancel, memory_order_relaxed))))
+        ctx->stop = true;                                         // Check the clock and the cancel flag every 1024 nodes.
+    if(ctx->stop)
+        return 0;
+
+    winner = getWinner(pos);
+    if(winner != NO_WINNER)                                       // A finished game, quicker wins score higher.
+        return (winner == MUSKETEERS_WIN) == (player == 'M') ? WIN_SCORE - ply : -(WIN_SCORE - ply);
+    if(ply > 0 && tablebase.data != NULL && POPCOUNT(pos->soldiers) <= tablebase.maxSoldiers){
+        value = tablebaseValue(&tablebase, pos->musketeers, pos->soldiers, player);
+        if(TB_IS_WIN(value))                                      // Perfect play is known, no need to search.
+            return WIN_SCORE - ply - TB_PLIES(value);
+        if(TB_IS_LOSS(value))
+            return -(WIN_SCORE - ply - TB_PLIES(value));
+    }
+    if(depth <= 0 || ply >= MAX_PLY - 1)
+        return evaluate(pos, player);
+
+    key = tableKey(pos, player, &symmetry);                      // Rotations and reflections share the entry.
+    if(probeTable(ctx->table, key, &tableScore, &tableDepth, &tableBound, &tableMove)){
+        tableMove = symmetryMoves[inverseSymmetry[symmetry]][tableMove];
+        if(tableScore > WIN_SCORE - MAX_PLY)                      // Win scores are stored from the position, not the root.
+            tableScore -= ply;
+        else if(tableScore < -(WIN_SCORE - MAX_PLY))
+            tableScore += ply;
+        if(ply > 0 && tableDepth >= depth){
+            if(tableBound == BOUND_EXACT
+               || (tableBound == BOUND_LOWER && tableScore >= beta)
+               || (tableBound == BOUND_UPPER && tableScore <= alpha))
+                return tableScore;
+        }
+    }
+
+    count = generateMoves(pos, player, moves);
+    if(count == 0)                                                // Soldiers that cannot move lose.
+        return -(WIN_SCORE - ply);
+
+    for(i = 0; i < count; i++){                                   // Table move first, then killers, then history.
+        if(moves[i] == tableMove)
+            order[i] = 1 << 30;
+        else if(moves[i] == ctx->killers[ply][0])
+            order[i] = 1 << 29;
+        else if(moves[i] == ctx->killers[ply][1])
+            order[i] = 1 << 28;
+        else order[i] = ctx->history[side][moves[i]];
+    }
+
+    for(i = 0; i < count; i++){
+        best = i;                                                 // Pick the best remaining move.
+        for(j = i + 1; j < count; j++)
+            if(order[j] > order[best])
+                best = j;
+        move = moves[best];
+        moves[best] = moves[i];
+        moves[i] = move;
+        score = order[best];
+        order[best] = order[i];
+        order[i] = score;
+
+        makeMove(pos, player, move);
+        score = -negamax(ctx, pos, opponent, depth - 1, ply + 1, -beta, -alpha);
+        unmakeMove(pos, player, move);
+        if(ctx->stop)
+            return 0;
+
+        if(score > bestScore){
+            bestScore = score;
+            bestMove = move;
+            if(score > alpha){
+                alpha = score;
+                if(alpha >= beta){                                // Remember the move that caused the cutoff.
+                    if(ctx->killers[ply][0] != move){
+                        ctx->killers[ply][1] = ctx->killers[ply][0];
+                        ctx->killers[ply][0] = move;
+                    }
+                    ctx->history[side][move] += depth * depth;
+                    break;
+                }
+            }
+        }
+    }
+
+    if(ply == 0)
+        ctx->rootMove = bestMove;
+
+    score = bestScore;                                            // Store win scores from the position.
+    if(score > WIN_SCORE - MAX_PLY)
+        score += ply;
+    else if(score < -(WIN_SCORE - MAX_PLY))
+        score -= ply;
+    storeTable(ctx->table, key, score, depth,
+               bestScore >= beta ? BOUND_LOWER : bestScore > originalAlpha ? BOUND_EXACT : BOUND_UPPER,
+               symmetryMoves[symmetry][bestMove]);
+    return bestScore;
+}
+
+Move searchBestMove(SearchContext *ctx, Position *pos, char player){
+    Move moves[MAX_MOVES];
+    char str[6];
+    int depth, score;
+
+    ctx->startTime = currentTime();
+    ctx->stop = false;
+    ctx->table->generation++;
+    if(generateMoves(pos, player, moves) == 0)
+        return NO_MOVE;
+    ctx->bestMove = moves[0];                                     // Used if not even depth 1 finishes.
+
+    for(depth = 1; depth <= ctx->maxDepth; depth++){
+        score = negamax(ctx, pos, player, depth, 0, -INFINITE_SCORE, INFINITE_SCORE);
+        if(ctx->stop)                                             // The last depth did not finish, keep the one before.
+            break;
+        ctx->bestMove = ctx->rootMove;
+        ctx->bestScore = score;
+        ctx->completedDepth = depth;
+        if(ctx->verbose){
+            moveToString(ctx->bestMove, str);
+            printf("depth %d score %d move %s nodes %llu time %.0f ms\n", depth, score, str,
+                   (unsigned long long)ctx->nodes, currentTime() - ctx->startTime);
+        }
+        if(score > WIN_SCORE - MAX_PLY || score < -(WIN_SCORE - MAX_PLY))
+            break;                                                // The game is decided, deeper searches find the same.
+        if(ctx->targetDepth > 0 && depth >= ctx->targetDepth)
+            break;                                                // A ponder already searched this deep, answer now.
+    }
+    METRIC_ADD(METRIC_SEARCH_NODES, ctx->nodes);
+    if(ctx->cancel == NULL)                                       // A ponder search is not the time of a move.
+        METRIC_THINK_TIME(currentTime() - ctx->startTime);
+    return ctx->bestMove;
+}
+
+void startPonder(Ponder *ponder, TranspositionTable *table, const Position *pos, char player, int maxDepth){
+    initSearch(&ponder->ctx, table, maxDepth, 0);                 // No time limit, it runs until it is cancelled.
+    ponder->ctx.cancel = &ponder->cancel;
+    ponder->pos = *pos;
+    ponder->player = player;
+    atomic_store(&ponder->cancel, false);
+    ponder->running = pthread_create(&ponder->thread, NULL, ponderThread, ponder) == 0;
+}
+
+void *ponderThread(void *arg){
+    Ponder *ponder = arg;
+
+    searchBestMove(&ponder->ctx, &ponder->pos, ponder->player);
+    return NULL;
+}
+
+void stopPonder(Ponder *ponder){
+    if(!ponder->running)
+        return;
+    atomic_store(&ponder->cancel, true);
+    pthread_join(ponder->thread, NULL);
+    ponder->running = false;
+}
+
+uint64_t nextRandom(uint64_t *state){
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+Move choosePolicyMove(Policy policy, Position *pos, char player, uint64_t *random, SearchContext *ctx){
+    Move moves[MAX_MOVES];
+    int count = generateMoves(pos, player, moves);
+    char opponent = player == 'M' ? 'o' : 'M';
+    Winner winner, own = player == 'M' ? MUSKETEERS_WIN : SOLDIERS_WIN;
+    int i, score, bestScore = -INFINITE_SCORE, ties = 0;
+    Move best = NO_MOVE;
+
+    if(count == 0)
+        return NO_MOVE;
+    if(policy == RANDOM_POLICY)
+        return moves[nextRandom(random) % count];
+    if(policy == SEARCH_POLICY)
+        return searchBestMove(ctx, pos, player);
+
+    for(i = 0; i < count; i++){                                   // Greedy: look one ply ahead.
+        makeMove(pos, player, moves[i]);
+        winner = getWinner(pos);
+        if(winner == NO_WINNER)
+            score = -evaluate(pos, opponent);
+        else score = winner == own ? WIN_SCORE : -WIN_SCORE;
+        unmakeMove(pos, player, moves[i]);
+
+        if(score > bestScore){
+            bestScore = score;
+            best = moves[i];
+            ties = 1;
+        }
+        else if(score == bestScore && nextRandom(random) % ++ties == 0)    // Pick one of the equal moves at random.
+            best = moves[i];
+    }
+    return best;
+}
+
+void *selfPlayThread(void *arg){
+    SelfPlayWorker *worker = arg;
+    const Options *options = worker->options;
+    bool searching = options->musketeerPolicy == SEARCH_POLICY || options->soldierPolicy == SEARCH_POLICY;
+    TranspositionTable table;
+    SearchContext ctx;
+    GameRecord record;
+    Position pos;
+    Winner winner;
+    Move move;
+    char player;
+    long game;
+    int ply;
+
+    if(searching && !initTable(&table, options->hashSize)){
+        worker->failed = true;
+        return NULL;
+    }
+
+    for(game = 0; game < worker->games; game++){
+        pos = *worker->start;
+        initRecord(&record, &pos);
+        winner = getWinner(&pos);
+        for(ply = 0; winner == NO_WINNER && ply < MAX_PLY; ply++){
+            player = ply % 2 == 0 ? 'M' : 'o';
+            if(searching)
+                initSearch(&ctx, &table, options->depth, options->timeLimit);
+            move = choosePolicyMove(player == 'M' ? options->musketeerPolicy : options->soldierPolicy,
+                                    &pos, player, &worker->random, searching ? &ctx : NULL);
+            if(move == NO_MOVE){                                  // Soldiers that cannot move lose.
+                winner = MUSKETEERS_WIN;
+                break;
+            }
+            makeMove(&pos, player, move);
+            recordMove(&record, move);
+            winner = getWinner(&pos);
+        }
+        if(worker->record != NULL){                               // Collect the game, write when the buffer is full.
+            record.result = winner;
+            if(worker->buffered + RECORD_HEADER_SIZE + MAX_GAME_MOVES > RECORD_BUFFER){
+                pthread_mutex_lock(worker->recordLock);
+                fwrite(worker->buffer, 1, worker->buffered, worker->record);
+                pthread_mutex_unlock(worker->recordLock);
+                worker->buffered = 0;
+            }
+            worker->buffered += encodeRecord(&record, worker->buffer + worker->buffered);
+        }
+        if(winner == MUSKETEERS_WIN)
+            worker->musketeerWins++;
+        else if(winner == SOLDIERS_WIN)
+            worker->soldierWins++;
+        worker->lengths[ply < MAX_PLY ? ply : MAX_PLY]++;
+    }
+
+    if(worker->record != NULL && worker->buffered > 0){
+        pthread_mutex_lock(worker->recordLock);
+        fwrite(worker->buffer, 1, worker->buffered, worker->record);
+        pthread_mutex_unlock(worker->recordLock);
+    }
+    if(searching)
+        freeTable(&table);
+    return NULL;
+}
+
+bool runSelfPlay(const Position *start, const Options *options){
+    SelfPlayWorker *workers = calloc(options->threads, sizeof(SelfPlayWorker));
+    pthread_t *threads = calloc(options->threads, sizeof(pthread_t));
+    long musketeerWins = 0, soldierWins = 0, lengths[MAX_PLY + 1] = {0};
+    long games = options->selfPlayGames, totalPlies = 0, count = 0;
+    int minLength = -1, maxLength = 0;
+    int i, started;
+    double startTime, seconds;
+    FILE *record = NULL;
+    pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER;
+    uint64_t seed = options->seedGiven ? options->seed : (uint64_t)time(NULL);
+
+    if(workers == NULL || threads == NULL){
+        printf("Not enough memory for %d threads\n", options->threads);
+        free(workers);
+        free(threads);
+        return false;
+    }
+    if(options->recordFile != NULL && (record = fopen(options->recordFile, "ab")) == NULL){
+        printf("Error opening file\n");
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    startTime = currentTime();
+    for(started = 0; started < options->threads; started++){
+        workers[started].options = options;
+        workers[started].start = start;
+        workers[started].games = games / options->threads + (started < games % options->threads);
+        workers[started].record = record;
+        workers[started].recordLock = &recordLock;
+        workers[started].random = 0x9E3779B97F4A7C15ULL * (started + 1) ^ seed;
+        if(workers[started].random == 0)
+            workers[started].random = 1;
+        if(pthread_create(&threads[started], NULL, selfPlayThread, &workers[started]) != 0)
+            break;
+    }
+    for(i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    seconds = (currentTime() - startTime) / 1000.0;
+    if(record != NULL)
+        fclose(record);
+
+    if(started < options->threads){
+        printf("Could not start thread %d\n", started + 1);
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    for(i = 0; i < options->threads; i++)
+        if(workers[i].failed){
+            printf("Not enough memory for the transposition table\n");
+            free(workers);
+            free(threads);
+            return false;
+        }
+
+    for(i = 0; i < options->threads; i++){                         // Add up the results of all threads.
+        musketeerWins += workers[i].musketeerWins;
+        soldierWins += workers[i].soldierWins;
+        for(started = 0; started <= MAX_PLY; started++)
+            lengths[started] += workers[i].lengths[started];
+    }
+
+    printf("Played %ld games in %.3f s (%.1f games per second), seed %llu\n", games, seconds,
+           seconds > 0 ? games / seconds : 0.0, (unsigned long long)seed);
+    printf("The Musketeers won %ld games (%.1f%%)\n", musketeerWins, games ? 100.0 * musketeerWins / games : 0.0);
+    printf("Cardinal Richelieu's men won %ld games (%.1f%%)\n", soldierWins, games ? 100.0 * soldierWins / games : 0.0);
+    if(games > musketeerWins + soldierWins)
+        printf("Unfinished after %d plies: %ld games\n", MAX_PLY, games - musketeerWins - soldierWins);
+
+    for(i = 0; i <= MAX_PLY; i++)
+        if(lengths[i] > 0){
+            if(minLength < 0)
+                minLength = i;
+            maxLength = i;
+            totalPlies += (long)i * lengths[i];
+            count += lengths[i];
+        }
+    printf("Game length: min %d, max %d, mean %.2f plies\n", minLength, maxLength, count ? (double)totalPlies / count : 0.0);
+    printf(" plies     games\n");
+    for(i = 0; i <= MAX_PLY; i++)
+        if(lengths[i] > 0)
+            printf("%6d %9ld\n", i, lengths[i]);
+
+    free(workers);
+    free(threads);
+    return true;
+}
+
+Bitboard transformBoard(Bitboard squares, int symmetry){
+    Bitboard transformed = 0;
+    int byte;
+
+    for(byte = 0; byte < SQUARE_BYTES; byte++)
+        transformed |= symmetryBytes[symmetry][byte][(squares >> 8*byte) & 0xFF];
+    return transformed;
+}
+
+int canonicalPosition(Bitboard musketeers, Bitboard soldiers, Bitboard *canonicalMusketeers, Bitboard *canonicalSoldiers){
+    Bitboard bestMusketeers = musketeers, bestSoldiers = soldiers, transformed;
+    int best = 0, t;
+
+    for(t = 1; t < SYMMETRIES; t++){
+        transformed = transformBoard(musketeers, t);
+        if(transformed > bestMusketeers)                          // The soldiers only matter on a tie.
+            continue;
+        if(transformed < bestMusketeers || transformBoard(soldiers, t) < bestSoldiers){
+            bestMusketeers = transformed;
+            bestSoldiers = transformBoard(soldiers, t);
+            best = t;
+        }
+    }
+    *canonicalMusketeers = bestMusketeers;
+    *canonicalSoldiers = bestSoldiers;
+    return best;
+}
+
+uint64_t hashSquares(Bitboard squares, int piece){
+    uint64_t hash = 0;
+    int byte;
+
+    for(byte = 0; byte < SQUARE_BYTES; byte++)
+        hash ^= zobristBytes[piece][byte][(squares >> 8*byte) & 0xFF];
+    return hash;
+}
+
+uint64_t rankSquares(Bitboard squares, Bitboard space){
+    uint64_t rank = 0;
+    int k;
+
+    for(k = 1; squares; squares &= squares - 1, k++)               // The k-th square adds C(its number inside space, k).
+        rank += binomial[POPCOUNT(space & (BIT(FIRST_SQUARE(squares)) - 1))][k];
+    return rank;
+}
+
+bool initTablebaseIndex(void){
+    Bitboard musketeers, canonical, transformed;
+    int n, k, t;
+    uint64_t rank, count;
+
+    if(musketeerClasses != NULL)                                  // Already done.
+        return true;
+    for(n = 0; n <= N*N; n++)
+        for(k = 0; k <= N*N; k++)
+            binomial[n][k] = k == 0 ? 1 : n == 0 ? 0 : binomial[n-1][k-1] + binomial[n-1][k];
+
+    count = binomial[N*N][MUSKETEERS];
+    musketeerClasses = calloc(count, sizeof(MusketeerClass));
+    classMusketeers = calloc(count, sizeof(Bitboard));
+    if(musketeerClasses == NULL || classMusketeers == NULL)
+        return false;
+
+    // Go through the musketeer sets in increasing order, so a class representative is met before the rest of its class.
+    classCount = 0;
+    for(musketeers = BIT(MUSKETEERS) - 1; musketeers <= FULL_MASK; ){
+        canonical = musketeers;
+        for(t = 1; t < SYMMETRIES; t++){
+            transformed = transformBoard(musketeers, t);
+            if(transformed < canonical)
+                canonical = transformed;
+        }
+        rank = rankSquares(musketeers, FULL_MASK);
+        if(canonical == musketeers){                              // A new class.
+            classMusketeers[classCount] = musketeers;
+            musketeerClasses[rank].index = classCount++;
+        }
+        else musketeerClasses[rank].index = musketeerClasses[rankSquares(canonical, FULL_MASK)].index;
+        for(t = 0; t < SYMMETRIES; t++)
+            if(transformBoard(musketeers, t) == canonical)
+                musketeerClasses[rank].symmetries |= 1 << t;
+
+        Bitboard lowest = musketeers & -musketeers;               // Next set with the same number of squares(Gosper).
+        Bitboard ripple = musketeers + lowest;
+        musketeers = (((ripple ^ musketeers) >> 2) / lowest) | ripple;
+    }
+    return true;
+}
+
+uint8_t tablebaseValue(const Tablebase *tb, Bitboard musketeers, Bitboard soldiers, char player){
+    const TablebaseHeader *header = (const TablebaseHeader *)tb->data;
+    const MusketeerClass *cls = &musketeerClasses[rankSquares(musketeers, FULL_MASK)];
+    int count = POPCOUNT(soldiers);
+    Bitboard space, best = 0, transformed;
+    int t, bestSymmetry = -1;
+
+    if(count > tb->maxSoldiers)
+        return TB_NONE;
+    for(t = 0; t < SYMMETRIES; t++)                               // Among the symmetries that give the representative, take the smallest soldiers.
+        if(cls->symmetries & (1 << t)){
+            transformed = transformBoard(soldiers, t);
+            if(bestSymmetry < 0 || transformed < best){
+                best = transformed;
+                bestSymmetry = t;
+            }
+        }
+    space = ~classMusketeers[cls->index] & FULL_MASK;
+    return tb->data[header->offsets[count][player == 'M' ? 0 : 1]
+                    + cls->index * binomial[N*N - MUSKETEERS][count] + rankSquares(best, space)];
+}
+
+uint8_t solveTablebasePosition(const Tablebase *tb, Position *pos, char player){
+    Move moves[MAX_MOVES];
+    char opponent = player == 'M' ? 'o' : 'M';
+    Winner winner = getWinner(pos);
+    int count, i, quickestWin = -1, slowestLoss = -1;
+    bool draw = false;
+    uint8_t value;
+
+    if(winner != NO_WINNER)
+        return (winner == MUSKETEERS_WIN) == (player == 'M') ? TB_WIN(0) : TB_LOSS(0);
+    count = generateMoves(pos, player, moves);
+    if(count == 0)                                                // Soldiers that cannot move lose.
+        return TB_LOSS(0);
+
+    for(i = 0; i < count; i++){
+        makeMove(pos, player, moves[i]);
+        value = tablebaseValue(tb, pos->musketeers, pos->soldiers, opponent);
+        unmakeMove(pos, player, moves[i]);
+        if(TB_IS_LOSS(value)){                                    // The opponent loses after this move.
+            if(quickestWin < 0 || TB_PLIES(value) < quickestWin)
+                quickestWin = TB_PLIES(value);
+        }
+        else if(TB_IS_WIN(value)){
+            if(TB_PLIES(value) > slowestLoss)
+                slowestLoss = TB_PLIES(value);
+        }
+        else draw = true;
+    }
+    if(quickestWin >= 0)
+        return TB_WIN(quickestWin + 1);
+    if(draw)
+        return TB_DRAW;
+    return TB_LOSS(slowestLoss + 1);
+}
+
+void *tablebaseThread(void *arg){
+    TablebaseWorker *worker = arg;
+    Tablebase *tb = worker->tablebase;
+    const TablebaseHeader *header = (const TablebaseHeader *)tb->data;
+    uint64_t perClass = binomial[N*N - MUSKETEERS][worker->soldiers];
+    Bitboard musketeers, space, compressed, soldiers, rest, lowest, ripple;
+    int squares[N*N];                                             // The squares without a musketeer, in order.
+    int index, count, t, stabiliser;
+    uint64_t rank;
+    uint8_t *layer = tb->data + header->offsets[worker->soldiers][worker->player == 'M' ? 0 : 1];
+    Position pos;
+
+    while((index = atomic_fetch_add(worker->nextClass, 1)) < classCount){
+        musketeers = classMusketeers[index];
+        space = ~musketeers & FULL_MASK;
+        stabiliser = musketeerClasses[rankSquares(musketeers, FULL_MASK)].symmetries & ~1;
+        for(count = 0, rest = space; rest; rest &= rest - 1)
+            squares[count++] = FIRST_SQUARE(rest);
+
+        // Soldier sets in increasing order of the compressed bits are in increasing rank order.
+        compressed = ((Bitboard)1 << worker->soldiers) - 1;
+        for(rank = 0; rank < perClass; rank++){
+            for(soldiers = 0, rest = compressed; rest; rest &= rest - 1)
+                soldiers |= BIT(squares[FIRST_SQUARE(rest)]);
+
+            for(t = 1; t < SYMMETRIES; t++)                       // Skip sets that are stored under a smaller symmetric set.
+                if((stabiliser & (1 << t)) && transformBoard(soldiers, t) < soldiers)
+                    break;
+            if(t == SYMMETRIES){
+                setupPosition(&pos, musketeers, soldiers);
+                layer[index * perClass + rank] = solveTablebasePosition(tb, &pos, worker->player);
+                if(TB_IS_WIN(layer[index * perClass + rank]))
+                    worker->wins++;
+                else if(TB_IS_LOSS(layer[index * perClass + rank]))
+                    worker->losses++;
+            }
+
+            if(compressed == 0)                                   // Only the empty set.
+                break;
+            lowest = compressed & -compressed;                    // Next set with the same number of squares(Gosper).
+            ripple = compressed + lowest;
+            compressed = (((ripple ^ compressed) >> 2) / lowest) | ripple;
+        }
+    }
+    return NULL;
+}
+
+bool buildTablebase(const char *fileName, int maxSoldiers, int threads){
+    TablebaseHeader header;
+    TablebaseWorker *workers = calloc(threads, sizeof(TablebaseWorker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    Tablebase tb;
+    atomic_int nextClass;
+    uint64_t offset = sizeof(TablebaseHeader);
+    long wins, losses;
+    int soldiers, side, i, started, fd;
+    double startTime = currentTime();
+    bool ok = true;
+
+    if(workers == NULL || ids == NULL){
+        printf("Not enough memory for %d threads\n", threads);
+        free(workers);
+        free(ids);
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLEBASE_MAGIC, sizeof(header.magic));
+    header.boardSize = N;
+    header.musketeers = MUSKETEERS;
+    header.winLine = WIN_LINE;
+    header.maxSoldiers = maxSoldiers;
+    header.classCount = classCount;
+    for(soldiers = 0; soldiers <= maxSoldiers; soldiers++)
+        for(side = 0; side < 2; side++){
+            header.offsets[soldiers][side] = offset;
+            offset += classCount * binomial[N*N - MUSKETEERS][soldiers];
+        }
+    header.size = offset;
+
+    if((fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, header.size) != 0){
+        printf("Error opening file\n");
+        if(fd >= 0)
+            close(fd);
+        free(workers);
+        free(ids);
+        return false;
+    }
+    tb.data = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(tb.data == MAP_FAILED){
+        printf("Error mapping file\n");
+        free(workers);
+        free(ids);
+        return false;
+    }
+    tb.size = header.size;
+    tb.maxSoldiers = maxSoldiers;
+    memcpy(tb.data, &header, sizeof(header));
+    printf("Building %s: %d musketeer classes, %d to %d soldiers, %.1f MB\n",
+           fileName, classCount, 0, maxSoldiers, header.size / (1024.0 * 1024.0));
+
+    for(soldiers = 0; soldiers <= maxSoldiers && ok; soldiers++)
+        for(side = 0; side < 2 && ok; side++){                    // Musketeers to move first, soldier moves lead to them.
+            atomic_init(&nextClass, 0);
+            for(started = 0; started < threads; started++){
+                workers[started].tablebase = &tb;
+                workers[started].soldiers = soldiers;
+                workers[started].player = side == 0 ? 'M' : 'o';
+                workers[started].nextClass = &nextClass;
+                workers[started].wins = 0;
+                workers[started].losses = 0;
+                if(pthread_create(&ids[started], NULL, tablebaseThread, &workers[started]) != 0)
+                    break;
+            }
+            for(i = 0; i < started; i++)
+                pthread_join(ids[i], NULL);
+            if(started == 0){
+                printf("Could not start a thread\n");
+                ok = false;
+                break;
+            }
+            if(started < threads)                                 // The started threads took all classes.
+                threads = started;
+            for(wins = 0, losses = 0, i = 0; i < started; i++){
+                wins += workers[i].wins;
+                losses += workers[i].losses;
+            }
+            printf("%2d soldiers, %s to move: %ld wins, %ld losses (%.1f s)\n", soldiers,
+                   side == 0 ? "musketeers" : "soldiers  ", wins, losses, (currentTime() - startTime) / 1000.0);
+        }
+
+    msync(tb.data, tb.size, MS_SYNC);
+    munmap(tb.data, tb.size);
+    free(workers);
+    free(ids);
+    if(ok)
+        printf("Saving %s...Done\n", fileName);
+    return ok;
+}
+
+bool loadTablebase(Tablebase *tb, const char *fileName){
+    const TablebaseHeader *header;
+    struct stat info;
+    int fd;
+
+    if((fd = open(fileName, O_RDONLY)) < 0){
+        printf("Tablebase file not found\n");
+        return false;
+    }
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TablebaseHeader)){
+        printf("Tablebase file is too short\n");
+        close(fd);
+        return false;
+    }
+    tb->data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(tb->data == MAP_FAILED){
+        printf("Error mapping tablebase file\n");
+        tb->data = NULL;
+        return false;
+    }
+    tb->size = info.st_size;
+    header = (const TablebaseHeader *)tb->data;
+    if(memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) != 0 || header->boardSize != N
+       || header->musketeers != MUSKETEERS || header->winLine != WIN_LINE || header->classCount != (uint32_t)classCount || header->size != tb->size){
+        printf("Tablebase file does not match this board\n");
+        munmap(tb->data, tb->size);
+        tb->data = NULL;
+        return false;
+    }
+    tb->maxSoldiers = header->maxSoldiers;
+    return true;
+}
+
+Move tablebaseBestMove(const Tablebase *tb, Position *pos, char player, uint8_t *value){
+    Move moves[MAX_MOVES];
+    char opponent = player == 'M' ? 'o' : 'M';
+    int count, i, bestPlies = -1;
+    Move best = NO_MOVE;
+    uint8_t child;
+
+    *value = tablebaseValue(tb, pos->musketeers, pos->soldiers, player);
+    if(*value == TB_NONE || *value == TB_DRAW || getWinner(pos) != NO_WINNER)
+        return NO_MOVE;
+    count = generateMoves(pos, player, moves);
+    for(i = 0; i < count; i++){
+        makeMove(pos, player, moves[i]);
+        child = tablebaseValue(tb, pos->musketeers, pos->soldiers, opponent);
+        unmakeMove(pos, player, moves[i]);
+        if(TB_IS_WIN(*value) && TB_IS_LOSS(child) && (best == NO_MOVE || TB_PLIES(child) < bestPlies)){
+            best = moves[i];                                      // Quickest win.
+            bestPlies = TB_PLIES(child);
+        }
+        else if(TB_IS_LOSS(*value) && TB_IS_WIN(child) && TB_PLIES(child) > bestPlies){
+            best = moves[i];                                      // Slowest loss.
+            bestPlies = TB_PLIES(child);
+        }
+    }
+    return best;
+}
+
+const char *parseBoard(const char *p, const char *end, BatchItem *item){
+    Bitboard musketeers = 0, soldiers = 0;
+    int square = 0;
+
+    while(p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        p++;
+    if(p == end)
+        return NULL;
+
+    item->error = NULL;
+    for(; p < end && square < N*N; p++){
+        if(*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+            continue;
+        if(*p == 'M')
+            musketeers |= BIT(square);
+        else if(*p == 'o')
+            soldiers |= BIT(square);
+        else if(*p != '.')
+            item->error = "invalid-block";
+        square++;
+    }
+    if(square < N*N)
+        item->error = "incomplete-board";
+    else if(item->error == NULL && POPCOUNT(musketeers) != MUSKETEERS)
+        item->error = "wrong-musketeer-count";
+    setupPosition(&item->pos, musketeers, soldiers);
+    return p;
+}
+
+void analyseBoard(BatchItem *item, SearchContext *ctx, const Options *options){
+    item->winner = NO_WINNER;
+    item->score = 0;
+    item->move = NO_MOVE;
+    if(item->error != NULL)
+        return;
+    item->winner = getWinner(&item->pos);
+    if(item->winner != NO_WINNER)
+        return;
+    initSearch(ctx, ctx->table, options->depth, options->timeLimit);
+    item->move = searchBestMove(ctx, &item->pos, 'M');           // The musketeers move first, like in play().
+    item->score = ctx->bestScore;
+}
+
+void *batchThread(void *arg){
+    BatchWorker *worker = arg;
+    BatchQueue *queue = worker->queue;
+    SearchContext ctx;
+    int index;
+
+    ctx.table = &worker->table;
+    pthread_mutex_lock(&queue->gate);                             // Wait until the barriers are set up.
+    pthread_mutex_unlock(&queue->gate);
+    while(true){
+        pthread_barrier_wait(&queue->start);                      // Wait for a block.
+        if(queue->finished)
+            break;
+        while((index = atomic_fetch_add(&queue->next, 1)) < queue->count)
+            if(queue->items[index].source == index)              // Not a copy of another board or from the cache.
+                analyseBoard(&queue->items[index], &ctx, queue->options);
+        pthread_barrier_wait(&queue->done);
+    }
+    return NULL;
+}
+
+bool runBatch(const Options *options){
+    static BatchQueue queue;                                      // Too big for the stack.
+    int threads = options->staticBatch ? 0 : options->threads;   // The static evaluation needs no pool.
+    BatchWorker *workers = calloc(options->threads, sizeof(BatchWorker));
+    pthread_t *ids = calloc(options->threads, sizeof(pthread_t));
+    EvaluationBatch batch;
+    const char *names[] = {"none", "musketeers", "soldiers"};
+    const char *data, *p, *end;
+    BatchCacheEntry *cache = NULL;
+    FILE *fpout = NULL;
+    struct stat info;
+    long number, boards = 0, repeated = 0;
+    int file, fd, i, started = 0;
+    double startTime = currentTime();
+    char str[6];
+    bool ok = workers != NULL && ids != NULL;
+
+    if(ok && options->staticBatch && !initEvaluationBatch(&batch, BATCH_BLOCK)){
+        printf("Not enough memory for the evaluation batch\n");
+        ok = false;
+    }
+    for(i = 0; ok && i < threads; i++)
+        if(!initTable(&workers[i].table, options->hashSize)){
+            printf("Not enough memory for the transposition table\n");
+            ok = false;
+        }
+    if(ok && !options->staticBatch && (cache = calloc(BATCH_CACHE, sizeof(BatchCacheEntry))) == NULL){
+        printf("Not enough memory for the batch cache\n");
+        ok = false;
+    }
+    if(ok && (fpout = fopen(options->batchFile, "w")) == NULL){
+        printf("Error opening file\n");
+        ok = false;
+    }
+    if(!ok){
+        for(i = 0; workers != NULL && i < threads; i++)
+            free(workers[i].table.entries);
+        if(options->staticBatch)
+            freeEvaluationBatch(&batch);
+        free(cache);
+        free(workers);
+        free(ids);
+        return false;
+    }
+    setvbuf(fpout, NULL, _IOFBF, 1 << 20);
+
+    queue.options = options;
+    queue.finished = false;
+    pthread_mutex_init(&queue.gate, NULL);
+    pthread_mutex_lock(&queue.gate);
+    for(started = 0; started < threads; started++){
+        workers[started].queue = &queue;
+        if(pthread_create(&ids[started], NULL, batchThread, &workers[started]) != 0){
+            printf("Could not start thread %d\n", started + 1);
+            ok = false;
+            break;
+        }
+    }
+    pthread_barrier_init(&queue.start, NULL, started + 1);       // Only the threads that started meet there.
+    pthread_barrier_init(&queue.done, NULL, started + 1);
+    pthread_mutex_unlock(&queue.gate);
+
+    queue.count = 0;
+    for(file = 0; started == threads && file <= options->inputCount; file++){
+        data = NULL;
+        end = NULL;
+        if(file < options->inputCount){
+            if((fd = open(options->inputFiles[file], O_RDONLY)) < 0 || fstat(fd, &info) != 0){
+                printf("File not found: %s\n", options->inputFiles[file]);
+                if(fd >= 0)
+                    close(fd);
+                ok = false;
+                continue;
+            }
+            if(info.st_size > 0 && (data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+                printf("Error mapping file: %s\n", options->inputFiles[file]);
+                close(fd);
+                ok = false;
+                continue;
+            }
+            close(fd);
+            if(data != NULL){
+                madvise((void *)data, info.st_size, MADV_SEQUENTIAL);
+                end = data + info.st_size;
+            }
+        }
+
+        p = data;
+        number = 0;
+        while(true){
+            if(data != NULL && (p = parseBoard(p, end, &queue.items[queue.count])) != NULL){
+                queue.items[queue.count].file = options->inputFiles[file];
+                queue.items[queue.count].number = ++number;
+                queue.count++;
+            }
+            // Hand a full block, or the last one after the last file, to the thread pool.
+            if((queue.count == BATCH_BLOCK || (file == options->inputCount && queue.count > 0)) && options->staticBatch){
+                for(i = 0; i < queue.count; i++){
+                    batch.musketeers[i] = queue.items[i].pos.musketeers;
+                    batch.soldiers[i] = queue.items[i].pos.soldiers;
+                }
+                batch.count = queue.count;
+                evaluateBatch(&batch);
+                for(i = 0; i < queue.count; i++){
+                    BatchItem *item = &queue.items[i];
+                    if(item->error != NULL)
+                        fprintf(fpout, "%s:%ld illegal %s\n", item->file, item->number, item->error);
+                    else fprintf(fpout, "%s:%ld legal winner %s moves %d %d score %d\n", item->file, item->number,
+                                 names[batch.winners[i]], batch.musketeerMoves[i], batch.soldierMoves[i], batch.scores[i]);
+                }
+                boards += queue.count;
+                queue.count = 0;
+            }
+            else if(queue.count == BATCH_BLOCK || (file == options->inputCount && queue.count > 0)){
+                repeated += dedupeBlock(&queue, cache);
+                atomic_store(&queue.next, 0);
+                pthread_barrier_wait(&queue.start);
+                pthread_barrier_wait(&queue.done);
+                finishBlock(&queue, cache);
+                for(i = 0; i < queue.count; i++){
+                    BatchItem *item = &queue.items[i];
+                    if(item->error != NULL)
+                        fprintf(fpout, "%s:%ld illegal %s\n", item->file, item->number, item->error);
+                    else if(item->move == NO_MOVE)
+                        fprintf(fpout, "%s:%ld legal winner %s\n", item->file, item->number, names[item->winner]);
+                    else{
+                        moveToString(item->move, str);
+                        fprintf(fpout, "%s:%ld legal winner none score %d move %s\n", item->file, item->number, item->score, str);
+                    }
+                }
+                boards += queue.count;
+                queue.count = 0;
+            }
+            if(data == NULL || p == NULL)
+                break;
+        }
+        if(data != NULL)
+            munmap((void *)data, info.st_size);
+    }
+
+    queue.finished = true;                                        // Let the threads return.
+    pthread_barrier_wait(&queue.start);
+    for(i = 0; i < started; i++)
+        pthread_join(ids[i], NULL);
+    for(i = 0; i < threads; i++)
+        freeTable(&workers[i].table);
+    pthread_barrier_destroy(&queue.start);
+    pthread_barrier_destroy(&queue.done);
+    pthread_mutex_destroy(&queue.gate);
+    if(options->staticBatch)
+        freeEvaluationBatch(&batch);
+    fclose(fpout);
+    free(cache);
+    free(workers);
+    free(ids);
+
+    printf("Analysed %ld boards in %.3f s (%.1f boards per second)\n", boards,
+           (currentTime() - startTime) / 1000.0, boards * 1000.0 / (currentTime() - startTime + 1e-9));
+    if(!options->staticBatch)
+        printf("%ld boards were rotations or reflections of boards seen before\n", repeated);
+    printf("Saving %s...Done\n", options->batchFile);
+    return ok;
+}
+
+long dedupeBlock(BatchQueue *queue, BatchCacheEntry *cache){
+    BatchCacheEntry *entry;
+    BatchItem *item;
+    Bitboard musketeers, soldiers;
+    long repeated = 0;
+    int i;
+
+    for(i = 0; i < queue->count; i++){
+        item = &queue->items[i];
+        item->source = i;
+        if(item->error != NULL)
+            continue;
+        item->symmetry = canonicalPosition(item->pos.musketeers, item->pos.soldiers, &musketeers, &soldiers);
+        entry = &cache[(hashSquares(musketeers, 0) ^ hashSquares(soldiers, 1)) & (BATCH_CACHE - 1)];
+        if(entry->musketeers != musketeers || entry->soldiers != soldiers){
+            entry->musketeers = musketeers;                       // A new board, or another one in the slot.
+            entry->soldiers = soldiers;
+            entry->owner = i;
+            continue;
+        }
+        repeated++;
+        if(entry->owner >= 0){                                    // Searched in this block, copied when it is done.
+            item->source = entry->owner;
+            continue;
+        }
+        item->source = -1;
+        item->winner = entry->winner;
+        item->score = entry->score;
+        item->move = symmetryMoves[inverseSymmetry[item->symmetry]][entry->move];
+    }
+    return repeated;
+}
+
+void finishBlock(BatchQueue *queue, BatchCacheEntry *cache){
+    BatchCacheEntry *entry;
+    BatchItem *item, *source;
+    Bitboard musketeers, soldiers;
+    int i;
+
+    for(i = 0; i < queue->count; i++){
+        item = &queue->items[i];
+        if(item->error != NULL || item->source != i)
+            continue;
+        musketeers = transformBoard(item->pos.musketeers, item->symmetry);
+        soldiers = transformBoard(item->pos.soldiers, item->symmetry);
+        entry = &cache[(hashSquares(musketeers, 0) ^ hashSquares(soldiers, 1)) & (BATCH_CACHE - 1)];
+        if(entry->owner != i)                                     // A later board of the block took the slot.
+            continue;
+        entry->winner = item->winner;
+        entry->score = item->score;
+        entry->move = symmetryMoves[item->symmetry][item->move];
+        entry->owner = -1;
+    }
+    for(i = 0; i < queue->count; i++){
+        item = &queue->items[i];
+        if(item->source < 0 || item->source == i)
+            continue;
+        source = &queue->items[item->source];
+        item->winner = source->winner;
+        item->score = source->score;
+        item->move = symmetryMoves[inverseSymmetry[item->symmetry]][symmetryMoves[source->symmetry][source->move]];
+    }
+}
+
+bool initEvaluationBatch(EvaluationBatch *batch, size_t capacity){
+    size_t size = (capacity + 31) & ~(size_t)31;                 // aligned_alloc needs a multiple of the alignment.
+
+    batch->musketeers = aligned_alloc(32, size * sizeof(Bitboard));
+    batch->soldiers = aligned_alloc(32, size * sizeof(Bitboard));
+    batch->winners = aligned_alloc(32, size);
+    batch->musketeerMoves = aligned_alloc(32, size);
+    batch->soldierMoves = aligned_alloc(32, size);
+    batch->scores = aligned_alloc(32, size * sizeof(int16_t));
+    batch->count = 0;
+    batch->capacity = capacity;
+    if(batch->musketeers == NULL || batch->soldiers == NULL || batch->winners == NULL
+       || batch->musketeerMoves == NULL || batch->soldierMoves == NULL || batch->scores == NULL){
+        freeEvaluationBatch(batch);
+        return false;
+    }
+    return true;
+}
+
+void freeEvaluationBatch(EvaluationBatch *batch){
+    free(batch->musketeers);
+    free(batch->soldiers);
+    free(batch->winners);
+    free(batch->musketeerMoves);
+    free(batch->soldierMoves);
+    free(batch->scores);
+    batch->musketeers = batch->soldiers = NULL;
+    batch->winners = batch->musketeerMoves = batch->soldierMoves = NULL;
+    batch->scores = NULL;
+}
+
+void evaluateBatch(EvaluationBatch *batch){
+    size_t done = 0;
+
+#ifdef HAVE_AVX2_EVALUATOR
+    if(__builtin_cpu_supports("avx2")){
+        done = batch->count & ~(size_t)7;
+        evaluateBatchAvx2(batch, done);
+    }
+#endif
+    evaluateBatchScalar(batch, done, batch->count);
+    if(patternWeights != NULL)                                    // The scores of the tables of --weights.
+        for(done = 0; done < batch->count; done++)
+            batch->scores[done] = patternScore(patternWeights, batch->musketeers[done], batch->soldiers[done]);
+}
+
+void evaluateBatchScalar(EvaluationBatch *batch, size_t start, size_t end){
+    Bitboard musketeers, soldiers, empty, cols, reached;
+    int direction, i, rows, fullLines, musketeerMoves, soldierMoves;
+    bool contact;
+    size_t k;
+
+    for(k = start; k < end; k++){
+        musketeers = batch->musketeers[k];
+        soldiers = batch->soldiers[k];
+        empty = ~(musketeers | soldiers) & FULL_MASK;
+        musketeerMoves = soldierMoves = 0;
+        contact = false;
+        for(direction = UP; direction <= RIGHT; direction++){
+            reached = shiftBoard(musketeers, direction) & soldiers;
+            contact |= reached != 0;
+            musketeerMoves += POPCOUNT(reached);
+            soldierMoves += POPCOUNT(shiftBoard(soldiers, direction) & empty);
+        }
+        rows = fullLines = 0;
+        cols = 0;
+        for(i = 0; i < N; i++){
+            rows += (musketeers & rowMask[i]) != 0;
+            cols |= musketeers >> (i*N);
+            fullLines += POPCOUNT(musketeers & rowMask[i]) >= WIN_LINE;
+            fullLines += POPCOUNT(musketeers & colMask[i]) >= WIN_LINE;
+        }
+        cols &= rowMask[0];
+
+        batch->winners[k] = fullLines ? SOLDIERS_WIN : contact ? NO_WINNER : MUSKETEERS_WIN;
+        batch->musketeerMoves[k] = musketeerMoves;
+        batch->soldierMoves[k] = soldierMoves;
+        batch->scores[k] = 16 * (rows + POPCOUNT(cols)) + 4 * musketeerMoves - soldierMoves;
+    }
+}
+
+#ifdef HAVE_AVX2_EVALUATOR
+__attribute__((target("avx2"))) __m256i popcount8(__m256i squares){
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i bytes;
+
+    bytes = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(squares, nibble)),       // Count of every byte,
+                            _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi32(squares, 4), nibble)));
+    bytes = _mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1));                                   // then of every 16 bits,
+    return _mm256_madd_epi16(bytes, _mm256_set1_epi16(1));                                      // then of every 32 bits.
+}
+
+__attribute__((target("avx2"))) void evaluateBatchAvx2(EvaluationBatch *batch, size_t count){
+    const __m256i full = _mm256_set1_epi32(FULL_MASK);
+    const __m256i notFirstCol = _mm256_set1_epi32(FULL_MASK & ~colMask[0]);
+    const __m256i notLastCol = _mm256_set1_epi32(FULL_MASK & ~colMask[N-1]);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i winLine = _mm256_set1_epi32(WIN_LINE - 1);
+    __m256i musketeers, soldiers, empty, cols, shifted[4], reached, line;
+    __m256i musketeerMoves, soldierMoves, contacts, lines, rows, winners, scores, packed;
+    __m128i bytes;
+    int direction, i;
+    size_t k;
+
+    for(k = 0; k < count; k += 8){
+        musketeers = _mm256_loadu_si256((const __m256i *)(batch->musketeers + k));
+        soldiers = _mm256_loadu_si256((const __m256i *)(batch->soldiers + k));
+        empty = _mm256_andnot_si256(_mm256_or_si256(musketeers, soldiers), full);
+
+        // The four shifts of shiftBoard, for the musketeers and then for the soldiers.
+        shifted[UP] = _mm256_srli_epi32(musketeers, N);
+        shifted[DOWN] = _mm256_and_si256(_mm256_slli_epi32(musketeers, N), full);
+        shifted[LEFT] = _mm256_srli_epi32(_mm256_and_si256(musketeers, notFirstCol), 1);
+        shifted[RIGHT] = _mm256_slli_epi32(_mm256_and_si256(musketeers, notLastCol), 1);
+        musketeerMoves = contacts = zero;
+        for(direction = UP; direction <= RIGHT; direction++){
+            reached = _mm256_and_si256(shifted[direction], soldiers);
+            contacts = _mm256_or_si256(contacts, reached);
+            musketeerMoves = _mm256_add_epi32(musketeerMoves, popcount8(reached));
+        }
+        shifted[UP] = _mm256_srli_epi32(soldiers, N);
+        shifted[DOWN] = _mm256_and_si256(_mm256_slli_epi32(soldiers, N), full);
+        shifted[LEFT] = _mm256_srli_epi32(_mm256_and_si256(soldiers, notFirstCol), 1);
+        shifted[RIGHT] = _mm256_slli_epi32(_mm256_and_si256(soldiers, notLastCol), 1);
+        soldierMoves = zero;
+        for(direction = UP; direction <= RIGHT; direction++)
+            soldierMoves = _mm256_add_epi32(soldierMoves, popcount8(_mm256_and_si256(shifted[direction], empty)));
+
+        rows = lines = cols = zero;                               // lines is -1 in the lanes with a full line.
+        for(i = 0; i < N; i++){
+            line = popcount8(_mm256_and_si256(musketeers, _mm256_set1_epi32(rowMask[i])));
+            rows = _mm256_sub_epi32(rows, _mm256_cmpgt_epi32(line, zero));
+            lines = _mm256_or_si256(lines, _mm256_cmpgt_epi32(line, winLine));
+            line = popcount8(_mm256_and_si256(musketeers, _mm256_set1_epi32(colMask[i])));
+            lines = _mm256_or_si256(lines, _mm256_cmpgt_epi32(line, winLine));
+            cols = _mm256_or_si256(cols, _mm256_srli_epi32(musketeers, i*N));
+        }
+        cols = popcount8(_mm256_and_si256(cols, _mm256_set1_epi32(rowMask[0])));
+
+        // SOLDIERS_WIN with a full line, else MUSKETEERS_WIN without contacts, else NO_WINNER.
+        winners = _mm256_and_si256(_mm256_cmpeq_epi32(contacts, zero), _mm256_set1_epi32(MUSKETEERS_WIN));
+        winners = _mm256_blendv_epi8(winners, _mm256_set1_epi32(SOLDIERS_WIN), lines);
+        scores = _mm256_sub_epi32(_mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(rows, cols), 4),
+                                                   _mm256_slli_epi32(musketeerMoves, 2)), soldierMoves);
+
+        // Narrow the 32 bit lanes: 16 bits in the low half after the permute, then bytes.
+        packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(scores, scores), 0x08);
+        _mm_storeu_si128((__m128i *)(batch->scores + k), _mm256_castsi256_si128(packed));
+        packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(winners, musketeerMoves), 0xD8);
+        bytes = _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+        _mm_storel_epi64((__m128i *)(batch->winners + k), bytes);
+        _mm_storel_epi64((__m128i *)(batch->musketeerMoves + k), _mm_srli_si128(bytes, 8));
+        packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(soldierMoves, soldierMoves), 0x08);
+        bytes = _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64((__m128i *)(batch->soldierMoves + k), bytes);
+    }
+}
+#endif
+
+uint64_t perft(Position *pos, char player, int depth, PerftTable *table){
+    Move moves[MAX_MOVES];
+    char opponent = player == 'M' ? 'o' : 'M';
+    uint64_t key = 0, count = 0;
+    PerftEntry *entry = NULL;
+    int moveCount, i, symmetry;
+
+    if(depth == 0)
+        return 1;
+    if(getWinner(pos) != NO_WINNER)                               // The game is over.
+        return 0;
+    moveCount = generateMoves(pos, player, moves);
+    if(depth == 1)                                                // Every move ends a path.
+        return moveCount;
+
+    if(table != NULL){
+        key = tableKey(pos, player, &symmetry) ^ (0x9E3779B97F4A7C15ULL * depth);
+        entry = &table->entries[key & table->mask];
+        count = entry->count;
+        if((entry->check ^ count) == key)
+            return count;
+        count = 0;
+    }
+
+    for(i = 0; i < moveCount; i++){
+        makeMove(pos, player, moves[i]);
+        count += perft(pos, opponent, depth - 1, table);
+        unmakeMove(pos, player, moves[i]);
+    }
+
+    if(entry != NULL){
+        entry->check = key ^ count;
+        entry->count = count;
+    }
+    return count;
+}
+
+void *perftThread(void *arg){
+    PerftWorker *worker = arg;
+    Position pos = *worker->start;                                // Every thread moves on its own copy.
+    int index;
+
+    while((index = atomic_fetch_add(worker->nextMove, 1)) < worker->moveCount){
+        makeMove(&pos, worker->player, worker->moves[index]);
+        worker->counts[index] = perft(&pos, worker->player == 'M' ? 'o' : 'M', worker->depth - 1, worker->table);
+        unmakeMove(&pos, worker->player, worker->moves[index]);
+    }
+    return NULL;
+}
+
+bool runPerft(const Position *start, const Options *options){
+    Move moves[MAX_MOVES];
+    uint64_t counts[MAX_MOVES] = {0}, total = 0;
+    PerftWorker *workers = calloc(options->threads, sizeof(PerftWorker));
+    pthread_t *ids = calloc(options->threads, sizeof(pthread_t));
+    PerftTable table = {NULL, 0};
+    atomic_int nextMove;
+    Position pos = *start;
+    int moveCount, i, started;
+    size_t entries = 1;
+    double startTime, milliseconds;
+    char str[6];
+
+    if(workers == NULL || ids == NULL){
+        printf("Not enough memory for %d threads\n", options->threads);
+        free(workers);
+        free(ids);
+        return false;
+    }
+    if(options->perftHashSize > 0){
+        while(entries * 2 * sizeof(PerftEntry) <= (size_t)options->perftHashSize * 1024 * 1024)
+            entries *= 2;
+        if((table.entries = calloc(entries, sizeof(PerftEntry))) == NULL){
+            printf("Not enough memory for the perft cache\n");
+            free(workers);
+            free(ids);
+            return false;
+        }
+        table.mask = entries - 1;
+    }
+
+    startTime = currentTime();
+    moveCount = getWinner(&pos) == NO_WINNER ? generateMoves(&pos, 'M', moves) : 0;
+    atomic_init(&nextMove, 0);
+    for(started = 0; started < options->threads; started++){
+        workers[started].start = start;
+        workers[started].player = 'M';
+        workers[started].moves = moves;
+        workers[started].moveCount = moveCount;
+        workers[started].counts = counts;
+        workers[started].nextMove = &nextMove;
+        workers[started].table = table.entries != NULL ? &table : NULL;
+        workers[started].depth = options->perftDepth;
+        if(pthread_create(&ids[started], NULL, perftThread, &workers[started]) != 0)
+            break;
+    }
+    for(i = 0; i < started; i++)
+        pthread_join(ids[i], NULL);
+    milliseconds = currentTime() - startTime;
+
+    if(started == 0){
+        printf("Could not start a thread\n");
+        free(table.entries);
+        free(workers);
+        free(ids);
+        return false;
+    }
+    for(i = 0; i < moveCount; i++){
+        total += counts[i];
+        if(options->divide){
+            moveToString(moves[i], str);
+            printf("%s: %llu\n", str, (unsigned long long)counts[i]);
+        }
+    }
+    printf("perft %d: %llu paths in %.3f s (%.0f nodes per second)\n", options->perftDepth,
+           (unsigned long long)total, milliseconds / 1000.0, milliseconds > 0 ? total * 1000.0 / milliseconds : 0.0);
+
+    free(table.entries);
+    free(workers);
+    free(ids);
+    return true;
+}
+
+bool initMcts(MctsTree *tree, size_t megabytes){
+    tree->capacity = megabytes * 1024 * 1024 / sizeof(MctsNode);
+    if(tree->capacity > UINT32_MAX)                               // Children are found by 32-bit index.
+        tree->capacity = UINT32_MAX;
+    tree->nodes = malloc(tree->capacity * sizeof(MctsNode));
+    return tree->nodes != NULL && tree->capacity > 0;
+}
+
+void freeMcts(MctsTree *tree){
+    free(tree->nodes);
+    tree->nodes = NULL;
+}
+
+Winner randomPlayout(Position *pos, char player, uint64_t *random){
+    Move moves[MAX_MOVES];
+    Winner winner;
+    int count;
+
+    while((winner = getWinner(pos)) == NO_WINNER){
+        if((count = generateMoves(pos, player, moves)) == 0)      // Soldiers that cannot move lose.
+            return MUSKETEERS_WIN;
+        makeMove(pos, player, moves[nextRandom(random) % count]);
+        player = player == 'M' ? 'o' : 'M';
+    }
+    return winner;
+}
+
+void *mctsThread(void *arg){
+    MctsWorker *worker = arg;
+    MctsTree *tree = worker->tree;
+    MctsNode *path[MAX_PLY + 1];                                  // The nodes of one playout, path[0] is the root.
+    MctsNode *node, *child, *best;
+    Move moves[MAX_MOVES];
+    Position pos;
+    Winner winner, own;
+    char player;
+    int depth, count, expected, i, visits;
+    size_t first;
+    double score, bestScore, logVisits;
+
+    while(atomic_fetch_add(&tree->playouts, 1) < tree->maxPlayouts || tree->maxPlayouts == 0){
+        if(tree->timeLimit > 0 && currentTime() - tree->startTime >= tree->timeLimit)
+            break;
+
+        pos = *tree->root;
+        player = tree->player;
+        node = &tree->nodes[0];
+        path[0] = node;
+        depth = 0;
+        winner = getWinner(&pos);
+
+        while(winner == NO_WINNER){
+            count = atomic_load_explicit(&node->childCount, memory_order_acquire);
+            expected = 0;
+            // A leaf that was visited before is expanded by the one thread that wins the exchange.
+            if(count == 0 && (depth == 0 || atomic_load_explicit(&node->visits, memory_order_relaxed) > 0)
+               && atomic_compare_exchange_strong(&node->childCount, &expected, -1)){
+                count = generateMoves(&pos, player, moves);
+                first = atomic_fetch_add(&tree->used, count);
+                if(count == 0 || first + count > tree->capacity){ // Nothing to expand or the arena is full.
+                    atomic_store(&node->childCount, 0);
+                    count = 0;
+                }
+                else{
+                    for(i = 0; i < count; i++){
+                        child = &tree->nodes[first + i];
+                        atomic_init(&child->visits, 0);
+                        atomic_init(&child->wins, 0);
+                        atomic_init(&child->virtualLosses, 0);
+                        atomic_init(&child->childCount, 0);
+                        child->move = moves[i];
+                    }
+                    node->firstChild = first;
+                    atomic_store_explicit(&node->childCount, count, memory_order_release);
+                }
+            }
+            if(count <= 0 || depth == MAX_PLY)                    // A leaf: play the rest of the game at random.
+                break;
+
+            // UCT, virtual losses make the other threads try other children.
+            visits = atomic_load_explicit(&node->visits, memory_order_relaxed)
+                   + atomic_load_explicit(&node->virtualLosses, memory_order_relaxed);
+            logVisits = log(visits + 1.0);
+            best = NULL;
+            bestScore = -1.0;
+            for(i = 0; i < count; i++){
+                child = &tree->nodes[node->firstChild + i];
+                visits = atomic_load_explicit(&child->visits, memory_order_relaxed)
+                       + atomic_load_explicit(&child->virtualLosses, memory_order_relaxed);
+                if(visits == 0){                                  // Try every child once first.
+                    best = child;
+                    break;
+                }
+                score = (double)atomic_load_explicit(&child->wins, memory_order_relaxed) / visits
+                      + MCTS_EXPLORATION * sqrt(logVisits / visits);
+                if(score > bestScore){
+                    bestScore = score;
+                    best = child;
+                }
+            }
+            atomic_fetch_add_explicit(&best->virtualLosses, 1, memory_order_relaxed);
+            makeMove(&pos, player, best->move);
+            player = player == 'M' ? 'o' : 'M';
+            node = best;
+            path[++depth] = node;
+            winner = getWinner(&pos);
+        }
+
+        if(winner == NO_WINNER)
+            winner = randomPlayout(&pos, player, &worker->random);
+
+        for(i = depth; i >= 0; i--){                              // Add the result to the path.
+            // The player that moved into path[i] is the root player when i is odd.
+            own = ((i % 2 == 1) == (tree->player == 'M')) ? MUSKETEERS_WIN : SOLDIERS_WIN;
+            if(winner == own)
+                atomic_fetch_add_explicit(&path[i]->wins, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&path[i]->visits, 1, memory_order_relaxed);
+            if(i > 0)
+                atomic_fetch_sub_explicit(&path[i]->virtualLosses, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+Move mctsBestMove(MctsTree *tree, Position *pos, char player, const Options *options, double *winRate){
+    MctsWorker *workers = calloc(options->threads, sizeof(MctsWorker));
+    pthread_t *ids = calloc(options->threads, sizeof(pthread_t));
+    Move moves[MAX_MOVES];
+    MctsNode *root = &tree->nodes[0], *child;
+    Move best = NO_MOVE;
+    int i, started, count, visits, bestVisits = -1;
+
+    *winRate = 0.0;
+    if((count = generateMoves(pos, player, moves)) == 0)
+        return NO_MOVE;
+    if(workers == NULL || ids == NULL){                           // Without threads any legal move has to do.
+        free(workers);
+        free(ids);
+        return moves[0];
+    }
+
+    atomic_init(&root->visits, 0);                                // A new tree for every move.
+    atomic_init(&root->wins, 0);
+    atomic_init(&root->virtualLosses, 0);
+    atomic_init(&root->childCount, 0);
+    root->move = NO_MOVE;
+    atomic_store(&tree->used, 1);
+    atomic_store(&tree->playouts, 0);
+    tree->root = pos;
+    tree->player = player;
+    tree->maxPlayouts = options->playouts;
+    tree->timeLimit = options->timeLimit;
+    tree->startTime = currentTime();
+
+    for(started = 0; started < options->threads; started++){
+        workers[started].tree = tree;
+        workers[started].random = 0x9E3779B97F4A7C15ULL * (started + 1) ^ pos->hashes[0];
+        if(workers[started].random == 0)
+            workers[started].random = 1;
+        if(pthread_create(&ids[started], NULL, mctsThread, &workers[started]) != 0)
+            break;
+    }
+    if(started == 0)                                              // No thread could start, search in this one.
+        mctsThread(&workers[0]);
+    for(i = 0; i < started; i++)
+        pthread_join(ids[i], NULL);
+
+    count = atomic_load(&root->childCount);
+    for(i = 0; i < count; i++){                                   // The most visited child is the most reliable.
+        child = &tree->nodes[root->firstChild + i];
+        visits = atomic_load(&child->visits);
+        if(visits > bestVisits){
+            bestVisits = visits;
+            best = child->move;
+            *winRate = visits > 0 ? (double)atomic_load(&child->wins) / visits : 0.0;
+        }
+    }
+    METRIC_THINK_TIME(currentTime() - tree->startTime);
+    free(workers);
+    free(ids);
+    return best != NO_MOVE ? best : moves[0];
+}
+
+void initRecord(GameRecord *record, const Position *start){
+    record->start = *start;
+    record->result = NO_WINNER;
+    record->moveCount = 0;
+}
+
+void recordMove(GameRecord *record, Move move){
+    if(record->moveCount < MAX_GAME_MOVES)
+        record->moves[record->moveCount++] = move;
+}
+
+size_t encodeRecord(const GameRecord *record, uint8_t *buffer){
+    uint64_t musketeers = record->start.musketeers, soldiers = record->start.soldiers;
+    int i;
+
+    memcpy(buffer, RECORD_MAGIC, 4);
+    buffer[4] = RECORD_VERSION;
+    buffer[5] = N;
+    buffer[6] = record->result;
+    buffer[7] = 0;
+    for(i = 0; i < 8; i++){                                       // Little endian on every machine.
+        buffer[8 + i] = musketeers >> (8*i);
+        buffer[16 + i] = soldiers >> (8*i);
+    }
+    buffer[24] = record->moveCount & 0xFF;
+    buffer[25] = record->moveCount >> 8;
+    memcpy(buffer + RECORD_HEADER_SIZE, record->moves, record->moveCount);
+    return RECORD_HEADER_SIZE + record->moveCount;
+}
+
+bool appendRecord(const char *fileName, const GameRecord *record){
+    uint8_t buffer[RECORD_HEADER_SIZE + MAX_GAME_MOVES];
+    size_t size = encodeRecord(record, buffer);
+    FILE *fp;
+    bool ok;
+
+    if((fp = fopen(fileName, "ab")) == NULL)
+        return false;
+    ok = fwrite(buffer, 1, size, fp) == size;
+    return fclose(fp) == 0 && ok;
+}
+
+bool decodeRecordStart(const uint8_t *header, Position *start){
+    uint64_t musketeers = 0, soldiers = 0;
+    int i;
+
+    for(i = 7; i >= 0; i--){                                      // Little endian, 8 bytes each.
+        musketeers = musketeers << 8 | header[8 + i];
+        soldiers = soldiers << 8 | header[16 + i];
+    }
+    if(((musketeers | soldiers) & ~(uint64_t)FULL_MASK) != 0 || (musketeers & soldiers) != 0
+       || POPCOUNT((Bitboard)musketeers) != MUSKETEERS)
+        return false;
+    setupPosition(start, musketeers, soldiers);
+    return true;
+}
+
+bool replayRecords(const char *fileName){
+    const uint8_t *data, *p, *end;
+    struct stat info;
+    long games = 0, moves = 0, wrong = 0;
+    int fd, i, count;
+    Position pos;
+    MoveError error;
+    Winner winner;
+    char player, str[6];
+    double startTime, milliseconds;
+
+    if((fd = open(fileName, O_RDONLY)) < 0 || fstat(fd, &info) != 0){
+        printf("File not found\n");
+        if(fd >= 0)
+            close(fd);
+        return false;
+    }
+    if(info.st_size == 0){
+        close(fd);
+        printf("Replayed 0 games\n");
+        return true;
+    }
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        printf("Error mapping file\n");
+        return false;
+    }
+    madvise((void *)data, info.st_size, MADV_SEQUENTIAL);
+    end = data + info.st_size;
+
+    startTime = currentTime();
+    for(p = data; p < end; p += RECORD_HEADER_SIZE + count, games++){
+        if(end - p < RECORD_HEADER_SIZE || memcmp(p, RECORD_MAGIC, 4) != 0 || p[4] != RECORD_VERSION || p[5] != N){
+            printf("Game %ld: bad header at byte %ld\n", games + 1, (long)(p - data));
+            wrong++;
+            break;                                                // The rest of the file cannot be found.
+        }
+        count = p[24] | p[25] << 8;
+        if(end - p - RECORD_HEADER_SIZE < count){
+            printf("Game %ld: the file ends inside the game\n", games + 1);
+            wrong++;
+            break;
+        }
+        if(!decodeRecordStart(p, &pos)){
+            printf("Game %ld: illegal starting board\n", games + 1);
+            wrong++;
+            continue;                                             // The length of the game is still known.
+        }
+
+        winner = getWinner(&pos);
+        for(i = 0, player = 'M'; i < count; i++, player = player == 'M' ? 'o' : 'M'){
+            if(winner != NO_WINNER){
+                printf("Game %ld, ply %d: the game is already over\n", games + 1, i + 1);
+                break;
+            }
+            if((error = validateMove(&pos, player, p[RECORD_HEADER_SIZE + i])) != MOVE_OK){
+                moveToString(p[RECORD_HEADER_SIZE + i] < 4*N*N ? p[RECORD_HEADER_SIZE + i] : 0, str);
+                printf("Game %ld, ply %d (%s): %s\n", games + 1, i + 1, str, moveErrorText[error]);
+                break;
+            }
+            makeMove(&pos, player, p[RECORD_HEADER_SIZE + i]);
+            winner = getWinner(&pos);
+        }
+        moves += i;
+        if(i == count && winner == NO_WINNER && p[6] == MUSKETEERS_WIN && countMoves(&pos, player) == 0)
+            winner = MUSKETEERS_WIN;                              // The soldiers could not move.
+        if(i < count)
+            wrong++;
+        else if(winner != p[6]){
+            printf("Game %ld: the stored result does not match the moves\n", games + 1);
+            wrong++;
+        }
+    }
+    milliseconds = currentTime() - startTime;
+    munmap((void *)data, info.st_size);
+
+    printf("Replayed %ld games, %ld moves in %.3f s (%.0f moves per second), %ld wrong\n", games, moves,
+           milliseconds / 1000.0, milliseconds > 0 ? moves * 1000.0 / milliseconds : 0.0, wrong);
+    return wrong == 0;
+}
+
+void stopServer(int signal){
+    (void)signal;
+    serverStop = 1;
+}
+
+bool runServer(const Position *start, const Options *options){
+    GameServer server;
+    struct sockaddr_un address;
+    struct epoll_event event, events[256];
+    struct sigaction action;
+    struct rlimit limit;
+    sigset_t signals, previous;
+    uint64_t one;
+    int i, count;
+
+    if(strlen(options->serverSocket) >= sizeof(address.sun_path)){
+        printf("Socket path too long\n");
+        return false;
+    }
+    memset(&server, 0, sizeof(server));
+    server.start = start;
+    server.options = options;
+    server.slotCount = options->serverGames;
+    server.listenFd = server.epollFd = server.eventFd = -1;
+    if((server.slots = malloc(server.slotCount * sizeof(GameSlot))) == NULL){
+        printf("Not enough memory for %d games\n", server.slotCount);
+        return false;
+    }
+    for(i = 0; i < server.slotCount; i++){                        // Every slot starts on the free list.
+        server.slots[i].fd = -1;
+        server.slots[i].thinking = false;
+        server.slots[i].nextFree = i + 1 < server.slotCount ? i + 1 : -1;
+    }
+    if((options->computerMusketeers || options->computerSoldiers) && !initTable(&server.table, options->hashSize)){
+        printf("Not enough memory for the transposition table\n");
+        free(server.slots);
+        return false;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.wake, NULL);
+    pthread_cond_init(&server.recordWake, NULL);
+    sigemptyset(&signals);                                        // The search threads inherit the blocked stop signals,
+    sigaddset(&signals, SIGINT);                                  // so only the event loop takes them and its epoll_wait
+    sigaddset(&signals, SIGTERM);                                 // returns.
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    if(options->recordFile != NULL){                              // The record writer.
+        if((server.record = fopen(options->recordFile, "ab")) == NULL
+           || pthread_create(&server.writer, NULL, serverRecordThread, &server) != 0){
+            printf(server.record == NULL ? "Error opening file\n" : "Could not start the record writer\n");
+            stopServerThreads(&server);
+            pthread_sigmask(SIG_SETMASK, &previous, NULL);
+            if(options->computerMusketeers || options->computerSoldiers)
+                freeTable(&server.table);
+            free(server.slots);
+            return false;
+        }
+        server.writerRunning = true;
+    }
+    if(options->computerMusketeers || options->computerSoldiers){   // The search threads.
+        server.jobs = malloc(server.slotCount * sizeof(ServerJob));
+        server.results = malloc(server.slotCount * sizeof(ServerJob));
+        server.threads = malloc(options->threads * sizeof(pthread_t));
+        if(server.jobs == NULL || server.results == NULL || server.threads == NULL
+           || (server.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0){
+            printf("Not enough memory for the search threads\n");
+            stopServerThreads(&server);
+            pthread_sigmask(SIG_SETMASK, &previous, NULL);
+            freeTable(&server.table);
+            free(server.slots);
+            return false;
+        }
+        for(server.threadCount = 0; server.threadCount < options->threads; server.threadCount++)
+            if(pthread_create(&server.threads[server.threadCount], NULL, serverSearchThread, &server) != 0){
+                printf("Could not start thread %d\n", server.threadCount + 1);
+                stopServerThreads(&server);
+                pthread_sigmask(SIG_SETMASK, &previous, NULL);
+                freeTable(&server.table);
+                free(server.slots);
+                return false;
+            }
+    }
+
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)server.slotCount + 16){
+        limit.rlim_cur = limit.rlim_max < (rlim_t)server.slotCount + 16 ? limit.rlim_max : (rlim_t)server.slotCount + 16;
+        setrlimit(RLIMIT_NOFILE, &limit);                         // One descriptor per game.
+    }
+    memset(&action, 0, sizeof(action));                           // No SA_RESTART, so epoll_wait returns on a signal.
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);                // Unblocked only here, once the handler is set.
+    signal(SIGPIPE, SIG_IGN);                                     // A client that left must not stop the server.
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, options->serverSocket);
+    unlink(options->serverSocket);                                // Left by a server that did not stop cleanly.
+    if((server.listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0
+       || bind(server.listenFd, (struct sockaddr *)&address, sizeof(address)) != 0
+       || listen(server.listenFd, SOMAXCONN) != 0
+       || (server.epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0){
+        printf("Error opening socket %s: %s\n", options->serverSocket, strerror(errno));
+        if(server.listenFd >= 0)
+            close(server.listenFd);
+        stopServerThreads(&server);
+        if(options->computerMusketeers || options->computerSoldiers)
+            freeTable(&server.table);
+        free(server.slots);
+        return false;
+    }
+    event.events = EPOLLIN;
+    event.data.u32 = server.slotCount;                            // The index after the last slot is the listening socket.
+    epoll_ctl(server.epollFd, EPOLL_CTL_ADD, server.listenFd, &event);
+    if(server.eventFd >= 0){
+        event.data.u32 = server.slotCount + 1;                    // And the one after it the results of the threads.
+        epoll_ctl(server.epollFd, EPOLL_CTL_ADD, server.eventFd, &event);
+    }
+    server.freeSlot = 0;
+    printf("Serving up to %d games on %s\n", server.slotCount, options->serverSocket);
+    fflush(stdout);
+
+    while(!serverStop){
+        if((count = epoll_wait(server.epollFd, events, sizeof(events) / sizeof(events[0]), -1)) < 0){
+            if(errno == EINTR)
+                continue;
+            printf("Error waiting for events: %s\n", strerror(errno));
+            break;
+        }
+        for(i = 0; i < count; i++){
+            if(events[i].data.u32 == (uint32_t)server.slotCount)
+                serverAccept(&server);
+            else if(events[i].data.u32 == (uint32_t)server.slotCount + 1){
+                while(read(server.eventFd, &one, sizeof(one)) > 0)   // Reset the counter, then play every result.
+                    ;
+                serverResults(&server);
+            }
+            else if(server.slots[events[i].data.u32].fd < 0)      // Closed by an earlier event of this batch.
+                continue;
+            else if(events[i].events & (EPOLLERR | EPOLLHUP))
+                serverClose(&server, events[i].data.u32);
+            else{
+                if(events[i].events & EPOLLOUT)
+                    serverFlush(&server, events[i].data.u32);
+                if((events[i].events & EPOLLIN) && server.slots[events[i].data.u32].fd >= 0)
+                    serverRead(&server, events[i].data.u32);
+            }
+        }
+    }
+
+    for(i = 0; i < server.slotCount; i++)
+        if(server.slots[i].fd >= 0)
+            serverClose(&server, i);
+    stopServerThreads(&server);
+    close(server.epollFd);
+    close(server.listenFd);
+    unlink(options->serverSocket);
+    if(options->computerMusketeers || options->computerSoldiers)
+        freeTable(&server.table);
+    free(server.slots);
+    printf("Server stopped after %ld games, %ld moves\n", server.games, server.moves);
+    return serverStop != 0;
+}
+
+void serverAccept(GameServer *server){
+    struct epoll_event event;
+    char board[N][N];
+    char text[N*N + 1];
+    GameSlot *slot;
+    int fd, index, i, j;
+
+    while((fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        if((index = server->freeSlot) < 0){                      // Every slot is in use.
+            send(fd, "FULL\n", 5, MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+        slot = &server->slots[index];
+        server->freeSlot = slot->nextFree;
+        slot->fd = fd;
+        slot->pos = *server->start;
+        slot->player = 'M';
+        slot->closing = false;
+        slot->waitOutput = false;
+        slot->thinking = false;
+        slot->lineLength = 0;
+        slot->outputLength = 0;
+        initRecord(&slot->record, &slot->pos);
+        server->games++;
+
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+
+        positionToBoard(&slot->pos, board);
+        for(i = 0; i < N; i++)
+            for(j = 0; j < N; j++)
+                text[i*N + j] = board[i][j];
+        text[N*N] = '\0';
+        serverReply(slot, "READY %s M", text);
+        serverTurn(server, slot);
+        serverFlush(server, index);
+    }
+}
+
+void serverRead(GameServer *server, int index){
+    GameSlot *slot = &server->slots[index];
+    char buffer[512];
+    ssize_t size, i;
+
+    if((size = recv(slot->fd, buffer, sizeof(buffer), 0)) <= 0){
+        if(size == 0 || (errno != EAGAIN && errno != EINTR))     // The client left.
+            serverClose(server, index);
+        return;
+    }
+    for(i = 0; i < size && !slot->closing; i++){
+        if(buffer[i] == '\n'){
+            if(slot->lineLength > 0 && slot->line[slot->lineLength - 1] == '\r')
+                slot->lineLength--;
+            slot->line[slot->lineLength] = '\0';
+            slot->lineLength = 0;
+            serverLine(server, slot, slot->line);
+        }
+        else if(slot->lineLength < SLOT_LINE - 1)
+            slot->line[slot->lineLength++] = buffer[i];
+        else{
+            serverReply(slot, "ERROR line too long");
+            slot->closing = true;
+        }
+    }
+    serverFlush(server, index);
+}
+
+void serverLine(GameServer *server, GameSlot *slot, char *line){
+    MoveError error;
+    Move move;
+
+    if(line[0] == '\0')                                           // Empty lines are ignored.
+        return;
+    if(strcmp(line, "0,0=E") == 0 || strcmp(line, "0,0=e") == 0){
+        serverReply(slot, "BYE");
+        slot->closing = true;
+        return;
+    }
+    if(slot->thinking){                                           // The computer is to move.
+        serverReply(slot, "ERROR wait for the computer's move");
+        return;
+    }
+    if((move = stringToMove(line)) == NO_MOVE){
+        serverReply(slot, "ERROR wrong input syntax");
+        return;
+    }
+    if((error = validateMove(&slot->pos, slot->player, move)) != MOVE_OK){
+        serverReply(slot, "ERROR %s", moveErrorText[error]);
+        return;
+    }
+    makeMove(&slot->pos, slot->player, move);
+    recordMove(&slot->record, move);
+    server->moves++;
+    slot->player = slot->player == 'M' ? 'o' : 'M';
+    moveToString(move, line);                                     // Answer in capitals, as moveToString writes.
+    serverReply(slot, "OK %s", line);
+    serverTurn(server, slot);
+}
+
+void serverTurn(GameServer *server, GameSlot *slot){
+    const Options *options = server->options;
+    ServerJob *job;
+    Winner winner;
+
+    if(slot->closing)
+        return;
+    if((winner = getWinner(&slot->pos)) == NO_WINNER && countMoves(&slot->pos, slot->player) == 0)
+        winner = MUSKETEERS_WIN;                                  // Soldiers that cannot move lose the game.
+    if(winner != NO_WINNER){
+        serverReply(slot, "WIN %c", winner == MUSKETEERS_WIN ? 'M' : 'o');
+        slot->record.result = winner;
+        slot->closing = true;
+        return;
+    }
+    if(!(slot->player == 'M' ? options->computerMusketeers : options->computerSoldiers))
+        return;                                                   // The client moves.
+
+    pthread_mutex_lock(&server->lock);                            // A thread searches it, the loop goes on.
+    job = &server->jobs[(server->jobHead + server->jobCount++) % server->slotCount];
+    job->slot = slot - server->slots;
+    job->pos = slot->pos;
+    job->player = slot->player;
+    pthread_cond_signal(&server->wake);
+    pthread_mutex_unlock(&server->lock);
+    slot->thinking = true;
+}
+
+void *serverSearchThread(void *arg){
+    GameServer *server = arg;
+    const Options *options = server->options;
+    TranspositionTable table = server->table;                    // The entries are shared, the generation is not.
+    SearchContext ctx;
+    ServerJob job;
+    uint64_t one = 1;
+    uint8_t value;
+
+    pthread_mutex_lock(&server->lock);
+    while(true){
+        while(!server->stopping && server->jobCount == 0)
+            pthread_cond_wait(&server->wake, &server->lock);
+        if(server->stopping)
+            break;
+        job = server->jobs[server->jobHead];
+        server->jobHead = (server->jobHead + 1) % server->slotCount;
+        server->jobCount--;
+        pthread_mutex_unlock(&server->lock);
+
+        if(tablebase.data == NULL || (job.move = tablebaseBestMove(&tablebase, &job.pos, job.player, &value)) == NO_MOVE){
+            initSearch(&ctx, &table, options->depth, options->timeLimit);
+            job.move = searchBestMove(&ctx, &job.pos, job.player);
+        }
+
+        pthread_mutex_lock(&server->lock);
+        server->results[(server->resultHead + server->resultCount++) % server->slotCount] = job;
+        while(write(server->eventFd, &one, sizeof(one)) < 0 && errno == EINTR)   // Wake the loop.
+            ;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+void *serverRecordThread(void *arg){
+    GameServer *server = arg;
+    uint8_t *records;
+    size_t length;
+
+    pthread_mutex_lock(&server->lock);
+    while(true){
+        while(!server->stopping && server->recordLength == 0)
+            pthread_cond_wait(&server->recordWake, &server->lock);
+        if(server->recordLength == 0)                             // Stopping, and every game is written.
+            break;
+        records = server->records;                                // Take the whole queue, the loop starts a new one.
+        length = server->recordLength;
+        server->records = NULL;
+        server->recordLength = server->recordCapacity = 0;
+        pthread_mutex_unlock(&server->lock);
+
+        if(fwrite(records, 1, length, server->record) != length || fflush(server->record) != 0)
+            printf("Error writing the game record\n");
+        free(records);
+        pthread_mutex_lock(&server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+void serverQueueRecord(GameServer *server, const GameRecord *record){
+    size_t capacity;
+    uint8_t *grown;
+
+    pthread_mutex_lock(&server->lock);
+    if(server->recordLength + RECORD_HEADER_SIZE + MAX_GAME_MOVES > server->recordCapacity){
+        capacity = server->recordCapacity > 0 ? 2*server->recordCapacity : RECORD_BUFFER;
+        if((grown = realloc(server->records, capacity)) == NULL){
+            pthread_mutex_unlock(&server->lock);
+            printf("Error writing the game record\n");
+            return;
+        }
+        server->records = grown;
+        server->recordCapacity = capacity;
+    }
+    server->recordLength += encodeRecord(record, server->records + server->recordLength);
+    pthread_cond_signal(&server->recordWake);
+    pthread_mutex_unlock(&server->lock);
+}
+
+void serverResults(GameServer *server){
+    ServerJob job;
+    GameSlot *slot;
+    char str[6];
+
+    while(true){
+        pthread_mutex_lock(&server->lock);
+        if(server->resultCount == 0){
+            pthread_mutex_unlock(&server->lock);
+            return;
+        }
+        job = server->results[server->resultHead];
+        server->resultHead = (server->resultHead + 1) % server->slotCount;
+        server->resultCount--;
+        pthread_mutex_unlock(&server->lock);
+
+        slot = &server->slots[job.slot];
+        slot->thinking = false;
+        if(slot->fd < 0){                                         // The client left during the search.
+            slot->nextFree = server->freeSlot;
+            server->freeSlot = job.slot;
+            continue;
+        }
+        if(slot->closing)                                         // Said BYE, the output is still being sent.
+            continue;
+        makeMove(&slot->pos, slot->player, job.move);
+        recordMove(&slot->record, job.move);
+        server->moves++;
+        slot->player = slot->player == 'M' ? 'o' : 'M';
+        moveToString(job.move, str);
+        serverReply(slot, "MOVE %s", str);
+        serverTurn(server, slot);                                 // The next computer move waits for its own result.
+        serverFlush(server, job.slot);
+    }
+}
+
+void stopServerThreads(GameServer *server){
+    int i;
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->wake);
+    pthread_cond_signal(&server->recordWake);
+    pthread_mutex_unlock(&server->lock);
+    for(i = 0; i < server->threadCount; i++)
+        pthread_join(server->threads[i], NULL);
+    server->threadCount = 0;
+    if(server->writerRunning)                                     // It writes the games still queued first.
+        pthread_join(server->writer, NULL);
+    server->writerRunning = false;
+    if(server->record != NULL && fclose(server->record) != 0)
+        printf("Error writing the game record\n");
+    if(server->eventFd >= 0)
+        close(server->eventFd);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->wake);
+    pthread_cond_destroy(&server->recordWake);
+    free(server->jobs);
+    free(server->results);
+    free(server->threads);
+    free(server->records);
+}
+
+void serverReply(GameSlot *slot, const char *format, ...){
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(slot->output + slot->outputLength, SLOT_OUTPUT - slot->outputLength, format, args);
+    va_end(args);
+    if(length < 0 || slot->outputLength + length + 1 >= SLOT_OUTPUT){   // The client does not read its replies.
+        slot->outputLength = SLOT_OUTPUT;
+        slot->closing = true;
+        return;
+    }
+    slot->outputLength += length;
+    slot->output[slot->outputLength++] = '\n';
+}
+
+void serverFlush(GameServer *server, int index){
+    GameSlot *slot = &server->slots[index];
+    struct epoll_event event;
+    ssize_t sent;
+
+    if(slot->outputLength == SLOT_OUTPUT){                        // Overflowed, nothing more is sent.
+        serverClose(server, index);
+        return;
+    }
+    while(slot->outputLength > 0){
+        if((sent = send(slot->fd, slot->output, slot->outputLength, MSG_NOSIGNAL)) < 0){
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                serverClose(server, index);
+                return;
+            }
+            if(!slot->waitOutput){                                // Send the rest when the client reads.
+                event.events = EPOLLIN | EPOLLOUT;
+                event.data.u32 = index;
+                epoll_ctl(server->epollFd, EPOLL_CTL_MOD, slot->fd, &event);
+                slot->waitOutput = true;
+            }
+            return;
+        }
+        memmove(slot->output, slot->output + sent, slot->outputLength - sent);
+        slot->outputLength -= sent;
+    }
+    if(slot->closing)
+        serverClose(server, index);
+    else if(slot->waitOutput){
+        event.events = EPOLLIN;
+        event.data.u32 = index;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, slot->fd, &event);
+        slot->waitOutput = false;
+    }
+}
+
+void serverClose(GameServer *server, int index){
+    GameSlot *slot = &server->slots[index];
+
+    if(server->record != NULL && slot->record.moveCount > 0)        // Written by the writer thread, not here.
+        serverQueueRecord(server, &slot->record);
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, slot->fd, NULL);
+    close(slot->fd);
+    slot->fd = -1;
+    if(slot->thinking)                                            // serverResults frees it with the result.
+        return;
+    slot->nextFree = server->freeSlot;
+    server->freeSlot = index;
+}
+
+bool initProofSearch(ProofSearch *ps, size_t megabytes){
+    size_t count = 1;
+
+    while(count * 2 * PROOF_BUCKET * sizeof(ProofEntry) <= megabytes * 1024 * 1024)   // Largest power of two that fits.
+        count *= 2;
+    if((ps->entries = calloc(count * PROOF_BUCKET, sizeof(ProofEntry))) == NULL)
+        return false;
+    ps->mask = count - 1;
+    ps->nodes = 0;
+    ps->replaced = 0;
+    ps->ply = 0;
+    ps->rootPn = ps->rootDn = 1;
+    ps->startTime = currentTime();
+    ps->nextReport = ps->startTime + 1000;
+    return true;
+}
+
+void storeProof(ProofSearch *ps, uint64_t key, uint32_t pn, uint32_t dn, uint64_t work){
+    ProofEntry *bucket, *victim;
+    int i;
+
+    key |= 1;                                                     // 0 marks an empty entry.
+    bucket = &ps->entries[(key & ps->mask) * PROOF_BUCKET];
+    victim = &bucket[0];
+    for(i = 0; i < PROOF_BUCKET; i++){
+        if(bucket[i].key == key || bucket[i].key == 0){
+            victim = &bucket[i];
+            break;
+        }
+        if(bucket[i].work < victim->work)                         // The cheapest entry to search again.
+            victim = &bucket[i];
+    }
+    if(i == PROOF_BUCKET)
+        ps->replaced++;
+    victim->key = key;
+    victim->pn = pn;
+    victim->dn = dn;
+    victim->work = work;
+}
+
+void childNumbers(ProofSearch *ps, Position *pos, char player, Move move, uint32_t *pn, uint32_t *dn, uint64_t *work){
+    char opponent = player == 'M' ? 'o' : 'M';
+    ProofEntry *bucket;
+    uint64_t key;
+    Winner winner;
+    int i;
+
+    makeMove(pos, player, move);
+    *work = 0;
+    if((winner = getWinner(pos)) == NO_WINNER && opponent == 'o' && countMoves(pos, 'o') == 0)
+        winner = MUSKETEERS_WIN;                                  // Soldiers that cannot move lose the game.
+    if(winner != NO_WINNER){
+        *pn = (winner == MUSKETEERS_WIN) == (opponent == 'M') ? 0 : PN_INFINITE;
+        *dn = *pn == 0 ? PN_INFINITE : 0;
+    }
+    else{
+        *pn = *dn = 1;
+        key = positionKey(pos, opponent) | 1;
+        bucket = &ps->entries[(key & ps->mask) * PROOF_BUCKET];
+        for(i = 0; i < PROOF_BUCKET; i++)
+            if(bucket[i].key == key){
+                *pn = bucket[i].pn;
+                *dn = bucket[i].dn;
+                *work = bucket[i].work;
+                break;
+            }
+    }
+    unmakeMove(pos, player, move);
+}
+
+void proofSearch(ProofSearch *ps, Position *pos, char player, uint32_t thresholdPn, uint32_t thresholdDn){
+    Move moves[MAX_MOVES];
+    uint32_t childPn[MAX_MOVES], childDn[MAX_MOVES];
+    uint64_t work, nodes = ps->nodes, sum, limit, second;
+    uint32_t pn, dn, secondDn;
+    char opponent = player == 'M' ? 'o' : 'M';
+    int count = generateMoves(pos, player, moves);
+    int i, best;
+    double now;
+
+    ps->nodes++;
+    if((ps->nodes & 0xFFFF) == 0 && (now = currentTime()) >= ps->nextReport){
+        printf("pn %u dn %u nodes %llu nps %.0f table replacements %llu\n", ps->rootPn, ps->rootDn,
+               (unsigned long long)ps->nodes, ps->nodes * 1000.0 / (now - ps->startTime), (unsigned long long)ps->replaced);
+        fflush(stdout);
+        ps->nextReport = now + 1000;
+    }
+
+    while(true){
+        // The side to move wins when one move wins: pn is the least child dn and dn the sum of the child pns.
+        pn = secondDn = PN_INFINITE;
+        sum = 0;
+        best = 0;
+        for(i = 0; i < count; i++){
+            childNumbers(ps, pos, player, moves[i], &childPn[i], &childDn[i], &work);
+            if(childDn[i] < pn){
+                secondDn = pn;
+                pn = childDn[i];
+                best = i;
+            }
+            else if(childDn[i] < secondDn)
+                secondDn = childDn[i];
+            sum += childPn[i];
+        }
+        dn = sum < PN_INFINITE ? sum : PN_INFINITE;
+        if(ps->ply == 0){                                         // The root.
+            ps->rootPn = pn;
+            ps->rootDn = dn;
+        }
+        if(pn >= thresholdPn || dn >= thresholdDn)
+            break;
+
+        // The best child may use the rest of the dn budget, and its dn may grow a quarter past the second
+        // best(the 1 + epsilon trick), so the search does not switch between two children too often.
+        limit = (uint64_t)thresholdDn - dn + childPn[best];
+        second = secondDn + secondDn / 4 + 1;
+        makeMove(pos, player, moves[best]);
+        ps->ply++;
+        proofSearch(ps, pos, opponent, limit < PN_INFINITE ? limit : PN_INFINITE,
+                    thresholdPn < second ? thresholdPn : (uint32_t)second);
+        ps->ply--;
+        unmakeMove(pos, player, moves[best]);
+    }
+    storeProof(ps, positionKey(pos, player), pn, dn, ps->nodes - nodes);
+}
+
+bool runSolve(const Position *start, const Options *options){
+    const char *names[] = {"", "The Musketeers", "Cardinal Richelieu's men"};
+    ProofSearch ps;
+    Position pos = *start;
+    Move moves[MAX_MOVES], chosen;
+    uint32_t pn, dn;
+    uint64_t work, chosenWork;
+    char player = options->solvePlayer, winnerSide, str[6];
+    Winner winner;
+    double seconds;
+    int count, i, plies = 0;
+
+    if((winner = getWinner(&pos)) == NO_WINNER && player == 'o' && countMoves(&pos, 'o') == 0)
+        winner = MUSKETEERS_WIN;
+    if(winner != NO_WINNER){
+        printf("The game is already over. %s win!\n", names[winner]);
+        return true;
+    }
+    if(!initProofSearch(&ps, options->hashSize)){
+        printf("Not enough memory for the proof table\n");
+        return false;
+    }
+
+    proofSearch(&ps, &pos, player, PN_INFINITE, PN_INFINITE);
+    seconds = (currentTime() - ps.startTime) / 1000.0;
+    winnerSide = ps.rootPn == 0 ? player : (player == 'M' ? 'o' : 'M');
+    printf("pn %u dn %u nodes %llu nps %.0f table replacements %llu\n", ps.rootPn, ps.rootDn,
+           (unsigned long long)ps.nodes, ps.nodes / (seconds + 1e-9), (unsigned long long)ps.replaced);
+    printf("%s to move %s by force (%.3f s)\n", player == 'M' ? "The Musketeers" : "Cardinal Richelieu's men",
+           ps.rootPn == 0 ? "win" : "lose", seconds);
+
+    // The winner plays a move to a lost position, the loser the move that took the most work to refute.
+    printf("Proving line:");
+    while(getWinner(&pos) == NO_WINNER && (count = generateMoves(&pos, player, moves)) > 0){
+        proofSearch(&ps, &pos, player, PN_INFINITE, PN_INFINITE);    // Solved again if the table lost it.
+        chosen = moves[0];
+        chosenWork = 0;
+        for(i = 0; i < count; i++){
+            childNumbers(&ps, &pos, player, moves[i], &pn, &dn, &work);
+            if(player == winnerSide && dn == 0){
+                chosen = moves[i];
+                break;
+            }
+            if(player != winnerSide && work >= chosenWork){
+                chosen = moves[i];
+                chosenWork = work;
+            }
+        }
+        moveToString(chosen, str);
+        printf(" %s", str);
+        makeMove(&pos, player, chosen);
+        player = player == 'M' ? 'o' : 'M';
+        plies++;
+    }
+    printf("\n%s win after %d plies\n", winnerSide == 'M' ? names[MUSKETEERS_WIN] : names[SOLDIERS_WIN], plies);
+    displayBoard(&pos);
+    free(ps.entries);
+    return true;
+}
+
+bool collectBookPositions(Position *pos, char player, int plies, Position **positions, char **players, long *count, long *capacity){
+    Move moves[MAX_MOVES];
+    Position *grownPositions;
+    char *grownPlayers;
+    int moveCount, i;
+
+    if(getWinner(pos) != NO_WINNER || (moveCount = generateMoves(pos, player, moves)) == 0)
+        return true;                                              // The game is over, there is no move to store.
+    if(*count == *capacity){
+        *capacity = *capacity ? 2 * *capacity : 4096;
+        grownPositions = realloc(*positions, *capacity * sizeof(Position));
+        if(grownPositions != NULL)
+            *positions = grownPositions;
+        grownPlayers = realloc(*players, *capacity);
+        if(grownPlayers != NULL)
+            *players = grownPlayers;
+        if(grownPositions == NULL || grownPlayers == NULL)
+            return false;
+    }
+    (*positions)[*count] = *pos;
+    (*players)[(*count)++] = player;
+
+    for(i = 0; i < moveCount && plies > 0; i++){
+        makeMove(pos, player, moves[i]);
+        if(!collectBookPositions(pos, player == 'M' ? 'o' : 'M', plies - 1, positions, players, count, capacity))
+            return false;
+        unmakeMove(pos, player, moves[i]);
+    }
+    return true;
+}
+
+int compareBookPositions(const void *a, const void *b){
+    uint64_t first = ((const BookPosition *)a)->key, second = ((const BookPosition *)b)->key;
+
+    return first < second ? -1 : first > second;
+}
+
+void *bookThread(void *arg){
+    BookWorker *worker = arg;
+    TranspositionTable table;
+    SearchContext ctx;
+    BookEntry *entry;
+    long i;
+
+    if(!initTable(&table, worker->options->hashSize)){
+        worker->failed = true;
+        return NULL;
+    }
+    while((i = atomic_fetch_add(worker->next, 1)) < worker->count){
+        entry = &worker->entries[i];
+        initSearch(&ctx, &table, worker->options->depth, 0);
+        entry->move = searchBestMove(&ctx, &worker->positions[worker->index[i]], worker->players[worker->index[i]]);
+        entry->score = ctx.bestScore;
+        entry->depth = ctx.completedDepth;
+    }
+    freeTable(&table);
+    return NULL;
+}
+
+bool buildBook(const Options *options){
+    Position *positions = NULL, start;
+    char *players = NULL;
+    long count = 0, capacity = 0, unique, i;
+    long *index;
+    BookPosition *sorted;
+    BookEntry *entries;
+    BookWorker *workers;
+    pthread_t *threads;
+    BookHeader header;
+    atomic_long next = 0;
+    FILE *fp;
+    int file, started;
+    bool ok = true;
+    double startTime = currentTime();
+
+    for(file = 0; file < options->inputCount && ok; file++){
+        if(!readBoard(&start, options->inputFiles[file]))
+            ok = false;
+        else if(!collectBookPositions(&start, 'M', options->bookPlies, &positions, &players, &count, &capacity)){
+            printf("Not enough memory for the book positions\n");
+            ok = false;
+        }
+    }
+    entries = calloc(count > 0 ? count : 1, sizeof(BookEntry));
+    index = malloc((count > 0 ? count : 1) * sizeof(long));
+    sorted = malloc((count > 0 ? count : 1) * sizeof(BookPosition));
+    workers = calloc(options->threads, sizeof(BookWorker));
+    threads = calloc(options->threads, sizeof(pthread_t));
+    if(ok && (entries == NULL || index == NULL || sorted == NULL || workers == NULL || threads == NULL)){
+        printf("Not enough memory for the book\n");
+        ok = false;
+    }
+    if(!ok){
+        free(positions);
+        free(players);
+        free(entries);
+        free(index);
+        free(sorted);
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    // Sort by key and drop the positions reached more than once, index keeps the position of every entry.
+    for(i = 0; i < count; i++){
+        sorted[i].key = positionKey(&positions[i], players[i]);
+        sorted[i].position = i;
+    }
+    qsort(sorted, count, sizeof(BookPosition), compareBookPositions);
+    for(unique = 0, i = 0; i < count; i++)
+        if(unique == 0 || sorted[i].key != entries[unique - 1].key){
+            entries[unique].key = sorted[i].key;
+            index[unique++] = sorted[i].position;
+        }
+    free(sorted);
+    printf("Searching %ld book positions to depth %d\n", unique, options->depth);
+    fflush(stdout);
+
+    for(started = 0; started < options->threads; started++){
+        workers[started].entries = entries;
+        workers[started].index = index;
+        workers[started].positions = positions;
+        workers[started].players = players;
+        workers[started].count = unique;
+        workers[started].next = &next;
+        workers[started].options = options;
+        if(pthread_create(&threads[started], NULL, bookThread, &workers[started]) != 0){
+            printf("Could not start thread %d\n", started + 1);
+            break;
+        }
+    }
+    for(i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+        ok = ok && !workers[i].failed;
+    }
+    if(started == 0 || !ok){
+        printf("The book was not built\n");
+        ok = false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, sizeof(header.magic));
+    header.boardSize = N;
+    header.musketeers = MUSKETEERS;
+    header.winLine = WIN_LINE;
+    header.plies = options->bookPlies;
+    header.count = unique;
+    if(ok && ((fp = fopen(options->buildBookFile, "wb")) == NULL || fwrite(&header, sizeof(header), 1, fp) != 1
+              || fwrite(entries, sizeof(BookEntry), unique, fp) != (size_t)unique || fclose(fp) != 0)){
+        printf("Error writing the book file\n");
+        ok = false;
+    }
+    if(ok)
+        printf("Saved %ld positions to %s in %.1f s\n", unique, options->buildBookFile, (currentTime() - startTime) / 1000.0);
+
+    free(positions);
+    free(players);
+    free(entries);
+    free(index);
+    free(workers);
+    free(threads);
+    return ok;
+}
+
+bool loadBook(OpeningBook *ob, const char *fileName){
+    const BookHeader *header;
+    struct stat info;
+    int fd;
+
+    if((fd = open(fileName, O_RDONLY)) < 0){
+        printf("Book file not found\n");
+        return false;
+    }
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(BookHeader)){
+        printf("Book file is too short\n");
+        close(fd);
+        return false;
+    }
+    ob->data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ob->data == MAP_FAILED){
+        printf("Error mapping book file\n");
+        ob->data = NULL;
+        return false;
+    }
+    ob->size = info.st_size;
+    header = ob->data;
+    if(memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) != 0 || header->boardSize != N || header->musketeers != MUSKETEERS
+       || header->winLine != WIN_LINE || sizeof(BookHeader) + header->count * sizeof(BookEntry) != ob->size){
+        printf("Book file does not match this board\n");
+        munmap(ob->data, ob->size);
+        ob->data = NULL;
+        return false;
+    }
+    ob->entries = (const BookEntry *)((const char *)ob->data + sizeof(BookHeader));
+    ob->count = header->count;
+    return true;
+}
+
+Move bookMove(const OpeningBook *ob, const Position *pos, char player, int *score){
+    uint64_t key = positionKey(pos, player);
+    uint64_t low = 0, high = ob->count, middle;
+
+    while(low < high){                                            // First entry with a key that is not smaller.
+        middle = low + (high - low) / 2;
+        if(ob->entries[middle].key < key)
+            low = middle + 1;
+        else high = middle;
+    }
+    if(low == ob->count || ob->entries[low].key != key || validateMove(pos, player, ob->entries[low].move) != MOVE_OK)
+        return NO_MOVE;                                           // Not in the book, or another position with the same key.
+    *score = ob->entries[low].score;
+    return ob->entries[low].move;
+}
+
+bool initBench(BenchData *data, const Options *options){
+    BatchItem item;
+    Bitboard pieces;
+    FILE *fp;
+    long size, capacity = 0, i;
+    const char *p, *end;
+    char *grown, str[6];
+    int file, square, direction, board;
+    bool ok = true;
+
+    memset(data, 0, sizeof(*data));
+    data->options = options;
+    for(file = 0; file < options->inputCount && ok; file++){
+        if((fp = fopen(options->inputFiles[file], "rb")) == NULL){
+            printf("File not found: %s\n", options->inputFiles[file]);
+            return false;
+        }
+        if(fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0
+           || (grown = realloc(data->text, data->textSize + size + 1)) == NULL){
+            printf("Error reading %s\n", options->inputFiles[file]);
+            fclose(fp);
+            return false;
+        }
+        data->text = grown;
+        if(fread(data->text + data->textSize, 1, size, fp) != (size_t)size)
+            ok = false;
+        fclose(fp);
+        data->textSize += size;
+        data->text[data->textSize++] = '\n';                     // Keeps the boards of two files apart.
+    }
+
+    // Every legal board of the input files, and the positions a few plies from it.
+    end = data->text + data->textSize;
+    for(p = data->text, board = 0; ok && (p = parseBoard(p, end, &item)) != NULL; board++){
+        if(item.error != NULL){
+            printf("Board %d of the input files is illegal: %s\n", board + 1, item.error);
+            return false;
+        }
+        if(data->startCount < BENCH_SEARCH_BOARDS && getWinner(&item.pos) == NO_WINNER)
+            data->starts[data->startCount++] = item.pos;
+        ok = collectBookPositions(&item.pos, 'M', BENCH_PLIES, &data->positions, &data->players, &data->count, &capacity);
+    }
+    if(!ok || data->count == 0 || data->startCount == 0){
+        printf(ok ? "The input files hold no board that is not over\n" : "Not enough memory for the benchmark\n");
+        return false;
+    }
+
+    // The moves a player could type on every position: every piece of the player in every direction.
+    data->moves = malloc(data->count * N*N*4 * sizeof(*data->moves));
+    data->moveOwner = malloc(data->count * N*N*4 * sizeof(long));
+    if(data->moves == NULL || data->moveOwner == NULL || !initTable(&data->table, options->hashSize)){
+        printf("Not enough memory for the benchmark\n");
+        return false;
+    }
+    for(i = 0; i < data->count; i++){
+        pieces = data->players[i] == 'M' ? data->positions[i].musketeers : data->positions[i].soldiers;
+        for(; pieces; pieces &= pieces - 1){
+            square = FIRST_SQUARE(pieces);
+            for(direction = 0; direction < 4; direction++){
+                moveToString((Move)(square << 2 | direction), str);
+                memcpy(data->moves[data->moveCount], str, 6);
+                data->moveOwner[data->moveCount++] = i;
+            }
+        }
+    }
+    return true;
+}
+
+void freeBench(BenchData *data){
+    free(data->positions);
+    free(data->players);
+    free(data->moves);
+    free(data->moveOwner);
+    free(data->text);
+    freeTable(&data->table);
+}
+
+uint64_t benchPass(BenchData *data, BenchWorkload workload, double *excluded){
+    Move moves[MAX_MOVES];
+    SearchContext ctx;
+    BatchItem item;
+    Position board;
+    const char *p, *end = data->text + data->textSize;
+    uint64_t operations = 0;
+    double start;
+    Move move;
+    long i;
+    int file;
+
+    switch(workload){
+    case BENCH_READ_BOARD:
+        for(file = 0; file < data->options->inputCount; file++, operations++)
+            if(readBoard(&board, data->options->inputFiles[file]))
+                data->sink += board.hashes[0];
+        break;
+    case BENCH_PARSE_BOARD:
+        for(p = data->text; (p = parseBoard(p, end, &item)) != NULL; operations++)
+            data->sink += item.pos.hashes[0];
+        break;
+    case BENCH_WINNER:
+        for(i = 0; i < data->count; i++, operations++)
+            data->sink += getWinner(&data->positions[i]);
+        break;
+    case BENCH_MOVE_BOARD:
+        for(i = 0; i < data->moveCount; i++, operations++){
+            board = data->positions[data->moveOwner[i]];
+            move = stringToMove(data->moves[i]);
+            if(validateMove(&board, data->players[data->moveOwner[i]], move) == MOVE_OK){
+                makeMove(&board, data->players[data->moveOwner[i]], move);
+                data->sink += board.hashes[0];
+            }
+        }
+        break;
+    case BENCH_GENERATE:
+        for(i = 0; i < data->count; i++, operations++)
+            data->sink += generateMoves(&data->positions[i], data->players[i], moves);
+        break;
+    case BENCH_EVALUATE:
+        for(i = 0; i < data->count; i++, operations++)
+            data->sink += evaluate(&data->positions[i], data->players[i]);
+        break;
+    default:
+        for(i = 0; i < data->startCount; i++){
+            start = currentTime();
+            memset(data->table.entries, 0, (data->table.mask + 1) * sizeof(TableEntry));
+            data->table.generation = 0;
+            board = data->starts[i];
+            *excluded += currentTime() - start;
+            initSearch(&ctx, &data->table, data->options->depth, 0);
+            data->sink += searchBestMove(&ctx, &board, 'M');
+            operations += ctx.nodes;
+        }
+    }
+    return operations;
+}
+
+void measureWorkload(BenchData *data, BenchWorkload workload, BenchResult *result){
+    int repetitions = data->options->benchRepetitions, r;
+    double start, excluded, total, variance = 0;
+    uint64_t operations;
+    long pass;
+
+    // The first pass also sizes the repetitions: enough passes to last about BENCH_SAMPLE_TIME.
+    excluded = 0;
+    start = currentTime();
+    benchPass(data, workload, &excluded);
+    total = currentTime() - start - excluded;
+    result->passes = total > 0 ? (long)(BENCH_SAMPLE_TIME / total) : 1000000;
+    if(result->passes < 1)
+        result->passes = 1;
+    for(r = -BENCH_WARMUP; r < repetitions; r++){
+        excluded = 0;
+        operations = 0;
+        start = currentTime();
+        for(pass = 0; pass < result->passes; pass++)
+            operations += benchPass(data, workload, &excluded);
+        total = currentTime() - start - excluded;
+        if(r >= 0)                                                // The warm-up repetitions are not kept.
+            result->samples[r] = operations > 0 ? total * 1e6 / operations : 0;
+        result->operations = operations;
+    }
+
+    result->mean = result->min = result->max = result->samples[0];
+    for(r = 1; r < repetitions; r++){
+        result->mean += result->samples[r];
+        if(result->samples[r] < result->min)
+            result->min = result->samples[r];
+        if(result->samples[r] > result->max)
+            result->max = result->samples[r];
+    }
+    result->mean /= repetitions;
+    for(r = 0; r < repetitions; r++)
+        variance += (result->samples[r] - result->mean) * (result->samples[r] - result->mean);
+    result->stddev = sqrt(variance / (repetitions - 1));         // Sample standard deviation.
+}
+
+bool runBench(const Options *options){
+    static const char *names[BENCH_WORKLOADS] = {"read-board", "parse-board", "winner", "move-board", "generate-moves",
+                                                 "evaluate", "search"};
+    BenchResult results[BENCH_WORKLOADS];
+    BenchData data;
+    FILE *fp;
+    int w, r;
+    bool ok;
+
+    memset(results, 0, sizeof(results));
+    ok = initBench(&data, options);
+    for(w = 0; ok && w < BENCH_WORKLOADS; w++)
+        if((results[w].samples = malloc(options->benchRepetitions * sizeof(double))) == NULL){
+            printf("Not enough memory for the benchmark\n");
+            ok = false;
+        }
+    if(ok){
+        printf("%ld positions, %ld move strings, %d boards searched to depth %d, %d repetitions\n",
+               data.count, data.moveCount, data.startCount, options->depth, options->benchRepetitions);
+        printf("%-16s %12s %10s %10s %10s %14s\n", "workload", "ns/op", "stddev", "min", "max", "ops/s");
+    }
+    for(w = 0; ok && w < BENCH_WORKLOADS; w++){
+        results[w].name = names[w];
+        results[w].unit = w == BENCH_SEARCH ? "node" : w == BENCH_READ_BOARD || w == BENCH_PARSE_BOARD ? "board"
+                        : w == BENCH_MOVE_BOARD ? "move" : "position";
+        measureWorkload(&data, w, &results[w]);
+        printf("%-16s %12.2f %10.2f %10.2f %10.2f %14.0f\n", names[w], results[w].mean, results[w].stddev,
+               results[w].min, results[w].max, 1e9 / results[w].mean);
+        fflush(stdout);
+    }
+
+    if(ok && (fp = fopen(options->benchFile, "w")) == NULL){
+        printf("Error opening file\n");
+        ok = false;
+    }
+    if(ok){
+        fprintf(fp, "{\n  \"board_size\": %d,\n  \"musketeers\": %d,\n  \"win_line\": %d,\n  \"compiler\": \"%s\",\n"
+                "  \"depth\": %d,\n  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"workloads\": [\n",
+                N, MUSKETEERS, WIN_LINE, __VERSION__, options->depth, options->benchRepetitions, BENCH_WARMUP);
+        for(w = 0; w < BENCH_WORKLOADS; w++){
+            fprintf(fp, "    {\"name\": \"%s\", \"unit\": \"%s\", \"operations\": %llu, \"passes\": %ld, "
+                    "\"ns_per_op\": {\"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f}, "
+                    "\"ops_per_second\": %.0f, \"samples\": [", results[w].name, results[w].unit,
+                    (unsigned long long)results[w].operations, results[w].passes, results[w].mean, results[w].stddev,
+                    results[w].min, results[w].max, 1e9 / results[w].mean);
+            for(r = 0; r < options->benchRepetitions; r++)
+                fprintf(fp, "%s%.3f", r ? ", " : "", results[w].samples[r]);
+            fprintf(fp, "]}%s\n", w + 1 < BENCH_WORKLOADS ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+        if(fclose(fp) != 0){
+            printf("Error writing the benchmark file\n");
+            ok = false;
+        }
+    }
+
+    for(w = 0; w < BENCH_WORKLOADS; w++)
+        free(results[w].samples);
+    freeBench(&data);
+    return ok;
+}
+
+#ifdef METRICS
+ThreadMetrics *registerMetrics(void){
+    ThreadMetrics *metrics = calloc(1, sizeof(ThreadMetrics));
+
+    if(metrics == NULL)                                           // Counted, just not apart from other threads.
+        return threadMetrics = &spareMetrics;
+    pthread_mutex_lock(&metricsLock);
+    metrics->next = metricsList;
+    metricsList = metrics;
+    pthread_mutex_unlock(&metricsLock);
+    return threadMetrics = metrics;
+}
+
+void metricAdd(Metric metric, uint64_t value){
+    ThreadMetrics *metrics = threadMetrics != NULL ? threadMetrics : registerMetrics();
+    atomic_uint_fast64_t *counter = &metrics->counters[metric];
+
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void metricThinkTime(double milliseconds){
+    ThreadMetrics *metrics = threadMetrics != NULL ? threadMetrics : registerMetrics();
+    atomic_uint_fast64_t *count, *sum = &metrics->thinkMicroseconds;
+    int bucket = 0;
+
+    while(bucket < THINK_BUCKETS - 1 && milliseconds > thinkBucketLimits[bucket])
+        bucket++;
+    count = &metrics->thinkCounts[bucket];
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(sum, atomic_load_explicit(sum, memory_order_relaxed) + (uint64_t)(milliseconds * 1000),
+                          memory_order_relaxed);
+}
+
+int readMetrics(ThreadMetrics *total){
+    ThreadMetrics *metrics;
+    int i, threads = 0;
+
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&metricsLock);
+    for(metrics = metricsList; metrics != NULL; metrics = metrics->next, threads++){
+        for(i = 0; i < METRIC_COUNTERS; i++)
+            total->counters[i] += atomic_load_explicit(&metrics->counters[i], memory_order_relaxed);
+        for(i = 0; i < THINK_BUCKETS; i++)
+            total->thinkCounts[i] += atomic_load_explicit(&metrics->thinkCounts[i], memory_order_relaxed);
+        total->thinkMicroseconds += atomic_load_explicit(&metrics->thinkMicroseconds, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&metricsLock);
+    return threads - 1;                                           // The spare metrics are not a thread.
+}
+
+bool writeMetrics(const char *base){
+    ThreadMetrics total;
+    char name[4096], temporary[4096 + 4];
+    uint64_t moves = 0, cumulative;
+    double hitRate;
+    FILE *fp;
+    int threads = readMetrics(&total), i, format;
+    bool ok = true;
+
+    hitRate = total.counters[METRIC_TABLE_PROBES] > 0
+            ? (double)total.counters[METRIC_TABLE_HITS] / total.counters[METRIC_TABLE_PROBES] : 0.0;
+    for(i = 0; i < THINK_BUCKETS; i++)
+        moves += total.thinkCounts[i];
+
+    for(format = 0; format < 2; format++){                        // JSON, then Prometheus.
+        snprintf(name, sizeof(name), "%s.%s", base, format == 0 ? "json" : "prom");
+        snprintf(temporary, sizeof(temporary), "%s.tmp", name);
+        if((fp = fopen(temporary, "w")) == NULL){
+            ok = false;
+            continue;
+        }
+        if(format == 0){
+            fprintf(fp, "{\n  \"threads\": %d,\n", threads);
+            for(i = 0; i < METRIC_COUNTERS; i++)
+                fprintf(fp, "  \"%s\": %llu,\n", metricNames[i], (unsigned long long)total.counters[i]);
+            fprintf(fp, "  \"table_hit_rate\": %.6f,\n  \"think_time\": {\"moves\": %llu, \"total_ms\": %.3f, \"buckets\": [",
+                    hitRate, (unsigned long long)moves, total.thinkMicroseconds / 1000.0);
+            for(i = 0; i < THINK_BUCKETS; i++){
+                if(i < THINK_BUCKETS - 1)
+                    fprintf(fp, "%s{\"le_ms\": %g, \"count\": %llu}", i ? ", " : "", thinkBucketLimits[i],
+                            (unsigned long long)total.thinkCounts[i]);
+                else fprintf(fp, ", {\"le_ms\": null, \"count\": %llu}", (unsigned long long)total.thinkCounts[i]);
+            }
+            fprintf(fp, "]}\n}\n");
+        }
+        else{
+            fprintf(fp, "# TYPE threemusketeers_moves_total counter\n");
+            fprintf(fp, "threemusketeers_moves_total{result=\"accepted\"} %llu\n",
+                    (unsigned long long)total.counters[METRIC_MOVES_ACCEPTED]);
+            fprintf(fp, "threemusketeers_moves_total{result=\"rejected\",reason=\"board_limit\"} %llu\n",
+                    (unsigned long long)total.counters[METRIC_REJECTED_BOARD_LIMIT]);
+            fprintf(fp, "threemusketeers_moves_total{result=\"rejected\",reason=\"current_block\"} %llu\n",
+                    (unsigned long long)total.counters[METRIC_REJECTED_CURRENT_BLOCK]);
+            fprintf(fp, "threemusketeers_moves_total{result=\"rejected\",reason=\"destination_block\"} %llu\n",
+                    (unsigned long long)total.counters[METRIC_REJECTED_DESTINATION_BLOCK]);
+            for(i = METRIC_WIN_CHECKS; i < METRIC_COUNTERS; i++)
+                fprintf(fp, "# TYPE threemusketeers_%s_total counter\nthreemusketeers_%s_total %llu\n",
+                        metricNames[i], metricNames[i], (unsigned long long)total.counters[i]);
+            fprintf(fp, "# TYPE threemusketeers_table_hit_ratio gauge\nthreemusketeers_table_hit_ratio %.6f\n", hitRate);
+            fprintf(fp, "# TYPE threemusketeers_think_seconds histogram\n");
+            for(cumulative = 0, i = 0; i < THINK_BUCKETS; i++){    // Prometheus buckets count everything up to the limit.
+                cumulative += total.thinkCounts[i];
+                if(i < THINK_BUCKETS - 1)
+                    fprintf(fp, "threemusketeers_think_seconds_bucket{le=\"%g\"} %llu\n", thinkBucketLimits[i] / 1000,
+                            (unsigned long long)cumulative);
+                else fprintf(fp, "threemusketeers_think_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+            }
+            fprintf(fp, "threemusketeers_think_seconds_sum %.6f\nthreemusketeers_think_seconds_count %llu\n",
+                    total.thinkMicroseconds / 1e6, (unsigned long long)moves);
+        }
+        if(fclose(fp) != 0 || rename(temporary, name) != 0)
+            ok = false;
+    }
+    return ok;
+}
+
+void writeMetricsAtExit(void){
+    if(!writeMetrics(metricsFile))
+        fprintf(stderr, "Error writing the metrics files\n");
+}
+
+void *metricsThread(void *arg){
+    sigset_t signals;
+    int signal;
+
+    (void)arg;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    while(true)
+        if(sigwait(&signals, &signal) == 0 && !writeMetrics(metricsFile))
+            fprintf(stderr, "Error writing the metrics files\n");
+    return NULL;
+}
+
+bool startMetrics(const char *base){
+    sigset_t signals;
+    pthread_t thread;
+
+    metricsFile = base;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if(pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0 || pthread_create(&thread, NULL, metricsThread, NULL) != 0){
+        printf("Could not start the metrics thread\n");
+        return false;
+    }
+    pthread_detach(thread);
+    atexit(writeMetricsAtExit);
+    return true;
+}
+#endif
+
+bool readRecord(const char *fileName, long game, GameRecord *record){
+    uint8_t header[RECORD_HEADER_SIZE];
+    FILE *fp;
+    long number;
+    int count = 0;
+    bool ok = true;
+
+    if((fp = fopen(fileName, "rb")) == NULL){
+        printf("File not found\n");
+        return false;
+    }
+    for(number = 1; ok && number <= game; number++){
+        if(number > 1 && fseek(fp, count, SEEK_CUR) != 0)         // Skip the moves of the game before.
+            ok = false;
+        else if(fread(header, 1, RECORD_HEADER_SIZE, fp) != RECORD_HEADER_SIZE){
+            printf("The record file has only %ld games\n", number - 1);
+            ok = false;
+        }
+        else if(memcmp(header, RECORD_MAGIC, 4) != 0 || header[4] != RECORD_VERSION || header[5] != N){
+            printf("Game %ld: bad header\n", number);
+            ok = false;
+        }
+        else count = header[24] | header[25] << 8;
+    }
+    if(ok && !decodeRecordStart(header, &record->start)){
+        printf("Game %ld: illegal starting board\n", game);
+        ok = false;
+    }
+    if(ok && count > MAX_GAME_MOVES){
+        printf("Game %ld: too many moves\n", game);
+        ok = false;
+    }
+    if(ok && fread(record->moves, 1, count, fp) != (size_t)count){
+        printf("Game %ld: the file ends inside the game\n", game);
+        ok = false;
+    }
+    fclose(fp);
+    if(!ok)
+        return false;
+
+    record->result = header[6];
+    record->moveCount = count;
+    return true;
+}
+
+void *analysisThread(void *arg){
+    GameAnalysis *analysis = arg;
+    TranspositionTable table = analysis->table;                  // The entries are shared, the generation is not.
+    SearchContext ctx;
+    Position pos;
+    int index;
+
+    while((index = analysis->count - 1 - atomic_fetch_add(&analysis->next, 1)) >= 0){
+        pos = analysis->positions[index];
+        analysis->bestMoves[index] = NO_MOVE;
+        if(getWinner(&pos) != NO_WINNER || countMoves(&pos, analysis->players[index]) == 0){
+            analysis->scores[index] = -WIN_SCORE;                 // Only the side to move can have lost.
+            if(getWinner(&pos) != NO_WINNER && (getWinner(&pos) == MUSKETEERS_WIN) == (analysis->players[index] == 'M'))
+                analysis->scores[index] = WIN_SCORE;
+            continue;
+        }
+        initSearch(&ctx, &table, analysis->options->depth, 0);
+        analysis->bestMoves[index] = searchBestMove(&ctx, &pos, analysis->players[index]);
+        analysis->scores[index] = ctx.bestScore;
+    }
+    return NULL;
+}
+
+void scoreToString(int score, char str[24]){
+    if(score > WIN_SCORE - MAX_PLY)
+        snprintf(str, 24, "M in %d", WIN_SCORE - score);
+    else if(score < -(WIN_SCORE - MAX_PLY))
+        snprintf(str, 24, "o in %d", WIN_SCORE + score);
+    else snprintf(str, 24, "%d", score);
+}
+
+bool analyseGame(const Options *options){
+    static GameAnalysis analysis;                                 // Too big for the stack.
+    static GameRecord record;
+    const char *marks[] = {"best", "inaccuracy", "blunder"};
+    pthread_t *threads = calloc(options->threads, sizeof(pthread_t));
+    char str[6], best[6], before[24], after[24], swing[24], name[64];
+    int i, started, scoreBefore, scoreAfter, loss, mark, counts[3] = {0, 0, 0};
+    double startTime = currentTime();
+    MoveError error;
+    bool won;
+
+    if(threads == NULL || !readRecord(options->analyseFile, options->analyseGame, &record)){
+        free(threads);
+        return false;
+    }
+
+    // Replay the game first, every position is searched on its own.
+    analysis.positions[0] = record.start;
+    analysis.players[0] = 'M';
+    for(i = 0; i < record.moveCount; i++){
+        analysis.positions[i + 1] = analysis.positions[i];
+        if(getWinner(&analysis.positions[i]) != NO_WINNER
+           || (error = validateMove(&analysis.positions[i], analysis.players[i], record.moves[i])) != MOVE_OK){
+            printf("Game %ld, ply %d: %s\n", options->analyseGame, i + 1,
+                   getWinner(&analysis.positions[i]) != NO_WINNER ? "the game is already over" : moveErrorText[error]);
+            free(threads);
+            return false;
+        }
+        makeMove(&analysis.positions[i + 1], analysis.players[i], record.moves[i]);
+        analysis.players[i + 1] = analysis.players[i] == 'M' ? 'o' : 'M';
+    }
+    analysis.count = record.moveCount + 1;
+    analysis.options = options;
+    atomic_store(&analysis.next, 0);
+    if(!initTable(&analysis.table, options->hashSize)){
+        printf("Not enough memory for the transposition table\n");
+        free(threads);
+        return false;
+    }
 
-    char board[N][N];                      // Declare the board
+    for(started = 0; started < options->threads; started++)
+        if(pthread_create(&threads[started], NULL, analysisThread, &analysis) != 0)
+            break;
+    if(started == 0)                                              // No thread could start, search in this one.
+        analysisThread(&analysis);
+    for(i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    freeTable(&analysis.table);
+    free(threads);
 
-    // Print game instructions
-    printf("***   The Three Musketeers Game   ***\n"
-    "To make a move, enter the location of the piece you want to move,\n"
-    "and the direction you want it to move. Locations are indicated as\n"
-    "a letter (A, B, C, D, E) followed by a number (1, 2, 3, 4, or 5).\n"
-    "Directions are indicated as left, right, up, down (L/l, R/r, U/u, D/d).\n"
-    "For example, to move the Musketeer from the top right-hand corner\n"
-    "to the row below, enter 'A,5=L' or 'a,5=l'(without quotes).\n"
-    "For convenience in typing, use lowercase letters.\n"
-    "Musketeers can move anywhere and soldiers can only move on empty blocks.\n\n");
+    printf("Game %ld of %s, %d moves, searched to depth %d in %.1f s\n", options->analyseGame, options->analyseFile,
+           record.moveCount, options->depth, (currentTime() - startTime) / 1000.0);
+    printf("%4s %6s %6s %10s %10s %6s %8s  %s\n", "ply", "player", "move", "before", "after", "best", "swing", "mark");
+    for(i = 0; i < record.moveCount; i++){
+        // Scores for the musketeers before and after the move, and the score the mover lost.
+        scoreBefore = analysis.players[i] == 'M' ? analysis.scores[i] : -analysis.scores[i];
+        scoreAfter = analysis.players[i + 1] == 'M' ? analysis.scores[i + 1] : -analysis.scores[i + 1];
+        loss = analysis.players[i] == 'M' ? scoreBefore - scoreAfter : scoreAfter - scoreBefore;
+        won = analysis.scores[i] > WIN_SCORE - MAX_PLY;
+        if(record.moves[i] == analysis.bestMoves[i] || loss < INACCURACY_LOSS)
+            mark = 0;
+        else if(loss >= BLUNDER_LOSS || (won && -analysis.scores[i + 1] <= WIN_SCORE - MAX_PLY))
+            mark = 2;
+        else mark = 1;
+        counts[mark]++;
 
-    if(!readBoard(board, argc, argv))        // Call readBoard to read the board from a file specified in the command line arguements
-        exit(1);                             // - if it returns false, exit the program.
-    
-    displayBoard(board);                     // Display the initial board.
+        moveToString(record.moves[i], str);
+        moveToString(analysis.bestMoves[i], best);
+        scoreToString(scoreBefore, before);
+        scoreToString(scoreAfter, after);
+        if(abs(scoreBefore) > WIN_SCORE - MAX_PLY || abs(scoreAfter) > WIN_SCORE - MAX_PLY)
+                                                                  // A decided game has no swing to speak of.
+            snprintf(swing, sizeof(swing), "-");
+        else snprintf(swing, sizeof(swing), "%+d", scoreAfter - scoreBefore);
+        printf("%4d %6c %6s %10s %10s %6s %8s  %s\n", i + 1, analysis.players[i], str, before, after,
+               mark == 0 ? str : best, swing, marks[mark]);
+    }
+    printf("%d best, %d inaccuracies, %d blunders\n", counts[0], counts[1], counts[2]);
 
-    if(!checkForWinner(board))               // Call checkForWinner - if it returns false, start the game loop.
-        play(board);                         // Play prompts the players to move and update the board until a winner is determined.
-                                            
+    snprintf(name, sizeof(name), "game-%ld.txt", options->analyseGame);
+    return writeBoard(&analysis.positions[record.moveCount], name);
+}
 
-    if(!writeBoard(board, argv))             // Call writeBoard to save the final game board to an output file.
-        exit(1);                             // - if it returns false, exit the program.
+void solveWorker(SolveHeader *shared, const Position *start, char player){
+    char opponent = player == 'M' ? 'o' : 'M';
+    TranspositionTable table;
+    SearchContext ctx;
+    Position pos;
+    Winner winner;
+    int i, unclaimed, score;
 
-    return 0;
+    table.entries = (TableEntry *)(shared + 1);
+    table.mask = shared->tableEntries - 1;
+    table.generation = 0;
+    for(i = 0; i < shared->moveCount; i++){
+        unclaimed = 0;
+        if(!atomic_compare_exchange_strong(&shared->claims[i], &unclaimed, getpid()))
+            continue;                                             // Done, failed or taken by another worker.
+        pos = *start;
+        makeMove(&pos, player, shared->moves[i]);
+        ctx.nodes = 0;
+        if((winner = getWinner(&pos)) == NO_WINNER && opponent == 'o' && countMoves(&pos, 'o') == 0)
+            winner = MUSKETEERS_WIN;                              // The soldiers cannot move.
+        if(winner != NO_WINNER)                                   // The move ends the game.
+            score = (winner == MUSKETEERS_WIN) == (player == 'M') ? WIN_SCORE - 1 : -(WIN_SCORE - 1);
+        else if(shared->depth == 1)
+            score = -evaluate(&pos, opponent);
+        else{
+            initSearch(&ctx, &table, shared->depth - 1, 0);
+            searchBestMove(&ctx, &pos, opponent);
+            score = -ctx.bestScore;                               // A win one ply further from the root.
+            if(score > WIN_SCORE - MAX_PLY)
+                score--;
+            else if(score < -(WIN_SCORE - MAX_PLY))
+                score++;
+        }
+        shared->scores[i] = score;
+        atomic_fetch_add(&shared->nodes, ctx.nodes);
+        atomic_store(&shared->claims[i], SOLVE_DONE);             // After the score, so the parent reads it whole.
+    }
 }
 
-bool readBoard(char board[N][N], int argc, char **argv){
-    FILE *fp;                                                 // File pointer for output file.
-    char *p = NULL;                                           // Pointer to go through the array
+bool writeCheckpoint(const SolveHeader *shared, size_t size, const char *fileName){
+    char temporary[4096];
+    FILE *fp;
+    bool ok;
 
-    if(argc!=2){                                              // If wrong number of arguements
-        printf("Wrong number of arguments\n");                // print error message and return false.
-        printf("./nameOfExecutable nameOfInputFile\n");
+    snprintf(temporary, sizeof(temporary), "%s.tmp", fileName);
+    if((fp = fopen(temporary, "wb")) == NULL)
         return false;
+    ok = fwrite(shared, 1, size, fp) == size && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    return ok && rename(temporary, fileName) == 0;
+}
+
+int loadCheckpoint(SolveHeader *shared, size_t size, const char *fileName){
+    SolveHeader header;
+    struct stat info;
+    FILE *fp;
+    int i, claim;
+
+    if((fp = fopen(fileName, "rb")) == NULL)
+        return 0;
+    if(fstat(fileno(fp), &info) != 0 || (size_t)info.st_size != size || fread(&header, sizeof(header), 1, fp) != 1
+       || memcmp(header.magic, shared->magic, sizeof(header.magic)) != 0 || header.key != shared->key
+       || header.boardSize != shared->boardSize || header.depth != shared->depth
+       || header.tableEntries != shared->tableEntries || header.moveCount != shared->moveCount
+       || memcmp(header.moves, shared->moves, sizeof(header.moves)) != 0){
+        fclose(fp);
+        return -1;
     }
-    if((fp = fopen(argv[1], "r")) == NULL){                   // If input is not found
-        printf("File not found\n");                           // print error message and return false.
-        return false;
+    rewind(fp);
+    if(fread(shared, 1, size, fp) != size){
+        fclose(fp);
+        return -1;
     }
-    for (p = &board[0][0]; p < &board[N][N]; p++)             // Read a character from file, and store it in the board.
-        fscanf(fp, " %c", p);
     fclose(fp);
-    return true;
+    for(i = 0; i < shared->moveCount; i++)
+        if((claim = atomic_load(&shared->claims[i])) > 0)         // Its worker was running, search it again.
+            atomic_store(&shared->claims[i], 0);
+    return 1;
 }
 
-void displayBoard(char board[N][N]){
-    int i, j;
-    printf("    1   2   3   4   5  \n");
-    for(i = 0; i < N; i++){
-        printf("  +---+---+---+---+---+\n%c |", 'A'+i);
-        for(j = 0; j < N; j++){
-            printf(" %c |",board[i][j]);
-        }
-        printf("\n");
+pid_t startSolveWorker(SolveHeader *shared, const Position *start, char player){
+    pid_t pid = fork();
+
+    if(pid == 0){
+        prctl(PR_SET_PDEATHSIG, SIGKILL);                         // Do not outlive the parent.
+        solveWorker(shared, start, player);
+        _exit(0);
     }
-    printf("  +---+---+---+---+---+\n");
+    return pid;
 }
 
-bool readInputMove(char *str, char player){
+bool runParallelSolve(const Position *start, const Options *options){
+    const char *names[] = {"", "The Musketeers", "Cardinal Richelieu's men"};
+    char player = options->solvePlayer, name[64], str[6];
+    Move moves[MAX_MOVES];
+    SolveHeader *shared;
+    Winner winner;
+    pid_t *workers, pid;
+    size_t entries = 1, size;
+    int count, i, fd, status, claim, loaded, running = 0, pending, done, finished = 0, best;
+    bool *reported, ok = true;
+    double startTime = currentTime(), lastCheckpoint = startTime, seconds;
+    struct timespec pause = {0, 100000000};                       // 100 ms between looks at the workers.
 
-    bool correctInput = false;                          // Boolean Variable turns true if input is correct.
-    
-    while(!correctInput){                               // Read Input until correct input is given by the user.
+    if((winner = getWinner(start)) == NO_WINNER && player == 'o' && countMoves(start, 'o') == 0)
+        winner = MUSKETEERS_WIN;
+    if(winner != NO_WINNER || (count = generateMoves(start, player, moves)) == 0){
+        printf("The game is already over. %s win!\n", names[winner != NO_WINNER ? winner : MUSKETEERS_WIN]);
+        return true;
+    }
 
-        correctInput = true;
+    while(entries * 2 * sizeof(TableEntry) <= (size_t)options->hashSize * 1024 * 1024)
+        entries *= 2;
+    size = sizeof(SolveHeader) + entries * sizeof(TableEntry);
+    snprintf(name, sizeof(name), "/threeMusketeers-%d", (int)getpid());
+    if((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0){
+        printf("Could not create the shared memory\n");
+        return false;
+    }
+    shm_unlink(name);                                             // Gone with the last mapping, even after a crash.
+    shared = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    workers = calloc(options->processes, sizeof(pid_t));
+    reported = calloc(count, sizeof(bool));
+    if(shared == MAP_FAILED || workers == NULL || reported == NULL){
+        printf("Not enough shared memory for the transposition table\n");
+        if(shared != MAP_FAILED)
+            munmap(shared, size);
+        free(workers);
+        free(reported);
+        return false;
+    }
 
-        if(player == 'M')                               // Print Input message depending on the player.
-            printf("Give the Musketeer's move\n>");
-        else printf("Give the enemy's move \n>");                    
-        scanf("%s", str);
-                                                                             // If input is "0,0=E" or "0,0=e" , return false.
-        if(*str == '0' && *(str+1) == ',' && *(str+2) == '0' && *(str+3) == '=' && (*(str+4) == 'E' || *(str+4) == 'e')){       
+    memcpy(shared->magic, SOLVE_MAGIC, sizeof(shared->magic));
+    shared->key = positionKey(start, player);
+    shared->boardSize = N;
+    shared->depth = options->depth;
+    shared->tableEntries = entries;
+    shared->moveCount = count;
+    memset(shared->moves, NO_MOVE, sizeof(shared->moves));
+    memcpy(shared->moves, moves, count);
+    if(options->checkpointFile != NULL){
+        if((loaded = loadCheckpoint(shared, size, options->checkpointFile)) < 0){
+            printf("%s is not a checkpoint of this solve(board, side, --depth and --hash must match)\n",
+                   options->checkpointFile);
+            munmap(shared, size);
+            free(workers);
+            free(reported);
             return false;
         }
-        if(strlen(str)!=5){                                                  // If Wrong input length, correctInput=false, read again.
-            printf("Wrong Input Lenght.\n");
-            correctInput = false;
-        }
-        if((!(*str>='a' && *str<='e') && !(*str>='A' && *str<='E'))){        // If Wrong row input, correctInput=false, read again.
-            printf("Wrong Row Input.\n");
-            correctInput = false;
+        for(i = 0, done = 0; loaded && i < count; i++)
+            done += atomic_load(&shared->claims[i]) == SOLVE_DONE;
+        if(loaded)
+            printf("Continuing from %s, %d of %d root moves are searched\n", options->checkpointFile, done, count);
+    }
+    printf("Solving with %d processes to depth %d, %d root moves\n", options->processes, options->depth, count);
+    fflush(stdout);                                               // The workers must not print it again.
+
+    while(true){
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+            for(i = 0; i < options->processes && workers[i] != pid; i++)
+                ;
+            if(i == options->processes)
+                continue;
+            workers[i] = 0;
+            running--;
+            if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                continue;
+            for(i = 0; i < count; i++){                           // Give the moves of the crashed worker back.
+                claim = pid;
+                if(atomic_load(&shared->claims[i]) != pid)
+                    continue;
+                moveToString(shared->moves[i], str);
+                printf("The worker on %s crashed, ", str);
+                if(++shared->crashes[i] >= SOLVE_RETRIES){
+                    printf("giving the move up\n");
+                    atomic_compare_exchange_strong(&shared->claims[i], &claim, SOLVE_FAILED);
+                }
+                else{
+                    printf("searching it again\n");
+                    atomic_compare_exchange_strong(&shared->claims[i], &claim, 0);
+                }
+                fflush(stdout);
+            }
         }
-        if(*(str+1)!=','){                                                   // If Wrong input syntax, correctInput=false, read again.
-            printf("Wrong Input Syntax.\n");
-            correctInput = false;
+
+        for(i = 0, pending = 0; i < count; i++){
+            claim = atomic_load(&shared->claims[i]);
+            pending += claim >= 0;
+            if(claim == SOLVE_DONE && !reported[i]){
+                reported[i] = true;
+                moveToString(shared->moves[i], str);
+                printf("%s score %d (%d of %d, %.1f s)\n", str, shared->scores[i], ++finished, count,
+                       (currentTime() - startTime) / 1000.0);
+                fflush(stdout);
+            }
         }
-        if((*(str+2)<'1' || *(str+2)>'5') ){                                 // If Wrong collumn input, correctInput=false, read again.
-            printf("Wrong Collumn Input.\n");
-            correctInput = false;
+        if(pending == 0 && running == 0)
+            break;
+        for(i = 0; i < options->processes && running < pending; i++)
+            if(workers[i] == 0){                                  // Start a worker, or one in place of a crashed one.
+                if((workers[i] = startSolveWorker(shared, start, player)) < 0){
+                    printf("Could not start a worker process\n");
+                    workers[i] = 0;
+                    break;
+                }
+                running++;
+            }
+        if(running == 0){                                         // No worker could start, the moves stay pending.
+            ok = false;
+            break;
         }
-        if(*(str+3)!='='){                                                   // If Wrong input syntax, correctInput=false, read again.
-            printf("Wrong Input Syntax.\n");
-            correctInput = false;
+
+        if(options->checkpointFile != NULL && currentTime() - lastCheckpoint >= options->checkpointInterval * 1000.0){
+            if(!writeCheckpoint(shared, size, options->checkpointFile))
+                printf("Error writing the checkpoint\n");
+            lastCheckpoint = currentTime();
         }
-                                                                             // If Wrong direction input, correctInput=false, read again.
-        if(*(str+4)!='R' && *(str+4)!='r' && *(str+4)!='L' && *(str+4)!='l' && *(str+4)!='U' && *(str+4)!='u' && *(str+4)!='D' && *(str+4)!='d'){
-            printf("Wrong direction Input.\n");
-            correctInput = false;
+        nanosleep(&pause, NULL);
+    }
+
+    if(options->checkpointFile != NULL && !writeCheckpoint(shared, size, options->checkpointFile)){
+        printf("Error writing the checkpoint\n");
+        ok = false;
+    }
+    seconds = (currentTime() - startTime) / 1000.0;
+    for(i = 0, best = -1; i < count; i++){
+        if(atomic_load(&shared->claims[i]) == SOLVE_FAILED){
+            moveToString(shared->moves[i], str);
+            printf("%s could not be searched\n", str);
+            ok = false;
         }
+        else if(best < 0 || shared->scores[i] > shared->scores[best])
+            best = i;
     }
-    return true;
+    if(best >= 0){
+        moveToString(shared->moves[best], str);
+        printf("Best move %s, score %d, %llu nodes in %.1f s\n", str, shared->scores[best],
+               (unsigned long long)atomic_load(&shared->nodes), seconds);
+        if(shared->scores[best] > WIN_SCORE - MAX_PLY)
+            printf("%s win in %d plies\n", names[player == 'M' ? MUSKETEERS_WIN : SOLDIERS_WIN], WIN_SCORE - shared->scores[best]);
+        else if(shared->scores[best] < -(WIN_SCORE - MAX_PLY))
+            printf("%s win in %d plies\n", names[player == 'M' ? SOLDIERS_WIN : MUSKETEERS_WIN], WIN_SCORE + shared->scores[best]);
+        else printf("Not decided within depth %d\n", options->depth);
+    }
+    munmap(shared, size);
+    free(workers);
+    free(reported);
+    return ok;
 }
 
-/**
- * @brief Checks if the destination block is correct.
- * 
- * Checks if the destination block for Musketeers is 'o' and if
- * the destination block for the enemy is '.'.
- * 
- * @param player The player that makes a move('M' - Musketeer, 'o' soldier).
- * @param destinationBlock The character in the destination block.
- * @return true Returns true when destination is valid.
- * @return false Returns false when destination block is not valid.
- */
-bool checkDestinationBlock(char player, char destinationBlock){
+ScriptError playScript(const Position *start, char *script, ScriptResult *result){
+    Position pos = *start;
+    char player = 'M', *token, *next;
+    Move move = NO_MOVE;
+    MoveError error;
 
-    if(player == 'M')                                          // Check if player is a musketeer.         
-        if(destinationBlock != 'o'){                           // If musketeer's destination block is not a soldier print error message and return false.
-            printf("Destination Block is not a soldier\n"); 
-            return false;
-        }
-    if(player == 'o')                                          // Check if player is a enemy.
-        if(destinationBlock != '.'){                           // If enemy's destination block is not an empty block, print error message and return false.
-            printf("Destination Block is not an empty block\n");
-            return false;
+    result->error = SCRIPT_OK;
+    result->plies = 0;
+    result->move[0] = '\0';
+    result->winner = getWinner(&pos);
+    for(token = strtok_r(script, " \t\r\n", &next); token != NULL; token = strtok_r(NULL, " \t\r\n", &next)){
+        if(strcmp(token, "0,0=E") == 0 || strcmp(token, "0,0=e") == 0)
+            break;                                                // The player left the game.
+        if(result->winner == NO_WINNER && player == 'o' && countMoves(&pos, 'o') == 0)
+            result->winner = MUSKETEERS_WIN;                      // The soldiers cannot move.
+        if(result->winner != NO_WINNER)
+            result->error = SCRIPT_GAME_OVER;
+        else if(result->plies == MAX_GAME_MOVES)
+            result->error = SCRIPT_TOO_LONG;
+        else if((move = stringToMove(token)) == NO_MOVE)
+            result->error = SCRIPT_SYNTAX;
+        else if((error = validateMove(&pos, player, move)) != MOVE_OK)
+            result->error = (ScriptError)error;                   // The first values are the same.
+        if(result->error != SCRIPT_OK){
+            snprintf(result->move, sizeof(result->move), "%s", token);
+            return result->error;
         }
-    return true;
+        makeMove(&pos, player, move);
+        result->plies++;
+        result->winner = getWinner(&pos);
+        player = player == 'M' ? 'o' : 'M';
+    }
+    if(result->winner == NO_WINNER && player == 'o' && countMoves(&pos, 'o') == 0)
+        result->winner = MUSKETEERS_WIN;
+    return SCRIPT_OK;
 }
 
-bool checkCurrentBlock(char player, char currentBlock){
-    if(player == 'M')                                         // Check if player is a musketeer. 
-        if(currentBlock != 'M'){                              // If block that the musketeer is trying to move is not musketeer, print message and return false.
-            printf("Block that you are trying to move is not Musketeer\n");
-            return false;
+bool runScripts(const Position *start, const char *fileName){
+    const char *winners[] = {"none", "M", "o"};
+    FILE *fp = strcmp(fileName, "-") == 0 ? stdin : fopen(fileName, "r");
+    char *line = NULL, *p;
+    size_t capacity = 0;
+    long scripts = 0, moves = 0, wrong = 0;
+    double startTime, milliseconds;
+    ScriptResult result;
+
+    if(fp == NULL){
+        printf("Error opening file\n");
+        return false;
+    }
+    startTime = currentTime();
+    while(getline(&line, &capacity, fp) != -1){
+        for(p = line; *p == ' ' || *p == '\t'; p++)
+            ;
+        if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')  // Comments and empty lines.
+            continue;
+        scripts++;
+        if(playScript(start, p, &result) == SCRIPT_OK)
+            printf("Script %ld: ok, %d plies, winner %s\n", scripts, result.plies, winners[result.winner]);
+        else{
+            printf("Script %ld, ply %d (%s): %s\n", scripts, result.plies + 1, result.move, scriptErrorText[result.error]);
+            wrong++;
         }
-    if(player == 'o')                                         // Check if player is enemy.
-            if(currentBlock != 'o'){                          // If block that the enemy is trying to move is not a soldier, print message and return false.
-                printf("Block you are trying to move is not a soldier\n");
-                return false;
-            }
-    return true;
+        moves += result.plies;
+    }
+    milliseconds = currentTime() - startTime;
+    free(line);
+    if(fp != stdin)
+        fclose(fp);
+
+    printf("Played %ld scripts, %ld moves in %.3f s (%.0f moves per second), %ld wrong\n", scripts, moves,
+           milliseconds / 1000.0, milliseconds > 0 ? moves * 1000.0 / milliseconds : 0.0, wrong);
+    return wrong == 0;
 }
 
-bool checkBoardLimit(char row, char col, char direction){           
-     if(((row == 'A' || row == 'a') && (direction == 'U' || direction == 'u'))    // If move is out of the board limit,
-      || ((row == 'E' || row == 'e') && (direction == 'D' || direction == 'd'))
-       || (col == '1' && (direction == 'L' || direction == 'l'))
-        || (col == '5' && (direction == 'R' || direction == 'r'))){ 
-            printf("This move gets out of the board.\n");                         // Print error message and return false. 
-            return false;     
+void patternFeatures(Bitboard musketeers, Bitboard soldiers, uint32_t features[PATTERN_FEATURES]){
+    uint64_t shiftedSoldiers = (uint64_t)soldiers << (N + 1), shiftedMusketeers = (uint64_t)musketeers << (N + 1);
+    Bitboard rest = musketeers, empty = ~(musketeers | soldiers) & FULL_MASK;
+    int rows[MUSKETEERS], cols[MUSKETEERS];
+    int i, k, square, soldierWindow, otherWindow, musketeerMoves = 0, soldierMoves = 0;
 
+    for(i = 0; i < MUSKETEERS; i++){
+        square = FIRST_SQUARE(rest);
+        rest &= rest - 1;
+        soldierWindow = (shiftedSoldiers >> patternShifts[square][0] & 7) | (shiftedSoldiers >> patternShifts[square][1] & 7) << 3
+                        | (shiftedSoldiers >> patternShifts[square][2] & 7) << 6;
+        otherWindow = (shiftedMusketeers >> patternShifts[square][0] & 7) | (shiftedMusketeers >> patternShifts[square][1] & 7) << 3
+                      | (shiftedMusketeers >> patternShifts[square][2] & 7) << 6;
+        otherWindow |= patternOffBoard[square];                   // 0 empty, 1 soldier, 2 musketeer or off the board.
+        features[i] = NEIGHBOUR_WEIGHTS + patternIndex[soldierWindow & ~otherWindow] + 2 * patternIndex[otherWindow];
+        rows[i] = square / N;
+        cols[i] = square % N;
     }
-    else return true;
-}
-
-char convertRowInput(char row){
-    if(row == 'A' || row == 'B' || row == 'C' || row == 'D' || row == 'E')      // Convert character to the integer equivalent to control the board
-            row = row-'A';
-        else row = row-'a';
-    return row;
+    for(k = UP; k <= RIGHT; k++){
+        musketeerMoves += POPCOUNT(shiftBoard(musketeers, k) & soldiers);
+        soldierMoves += POPCOUNT(shiftBoard(soldiers, k) & empty);
+    }
+    features[MUSKETEERS] = ALIGNMENT_WEIGHTS + alignmentPattern(rows) * ALIGNMENT_PATTERNS + alignmentPattern(cols);
+    features[MUSKETEERS + 1] = MUSKETEER_MOVE_WEIGHTS + musketeerMoves;
+    features[MUSKETEERS + 2] = SOLDIER_MOVE_WEIGHTS + soldierMoves;
 }
 
-bool moveBoard(char input[6], char board[N][N], char player){                 
-    char row = input[0];                                                      
-    char col = input[2];
-    char direction = input [4];
-    char destinationBlock;                                                 // Will be used in check methods
-    char currentBlock;                                                     // Will be used in check methods
+int alignmentPattern(const int lines[MUSKETEERS]){
+    int counts[N] = {0};                                          // Musketeers on every line so far.
+    int most = 1, first = lines[0], last = lines[0];
+    int i, same;
 
-    while(!checkBoardLimit(row, col, direction)){                          // Check if the move is not inside the board limit, and read again until it is.
-        if(!readInputMove(input, player))
-            return false; 
-        row = input[0];
-        col = input[2];
-        direction = input [4];
+    for(i = 0; i < MUSKETEERS; i++){                              // No branches, only conditional moves.
+        same = ++counts[lines[i]];
+        most = same > most ? same : most;
+        first = lines[i] < first ? lines[i] : first;
+        last = lines[i] > last ? lines[i] : last;
     }
+    return (most - 1) * N + last - first;
+}
 
-    row = convertRowInput(row);                                            // Convert characters to integer to control the board.
-    currentBlock = board[(int)row][(int)(col-'1')];                        // Declaring current block character.
+int patternScore(const int16_t *weights, Bitboard musketeers, Bitboard soldiers){
+    uint32_t features[PATTERN_FEATURES];
+    int i, score = 0;
 
-    if(direction == 'r' || direction == 'R')                               // Depending on the direction, the method declares the destination block character.
-        destinationBlock = board[(int)row][(int)(col-'1'+1)];
+    patternFeatures(musketeers, soldiers, features);
+    for(i = 0; i < PATTERN_FEATURES; i++)
+        score += weights[features[i]];
+    return score;
+}
 
-    else if(direction == 'l' || direction == 'L')
-        destinationBlock = board[(int)row][(int)(col-'1'-1)];
+void defaultPatternWeights(int16_t *weights){
+    int rows, cols, moves;
 
-    else if(direction == 'u' || direction == 'U')
-        destinationBlock = board[(int)(row-1)][(int)(col-'1')];
+    memset(weights, 0, PATTERN_WEIGHTS * sizeof(int16_t));
+    for(rows = 0; rows < ALIGNMENT_PATTERNS; rows++)            // Lines with a musketeer = MUSKETEERS + 1 - most.
+        for(cols = 0; cols < ALIGNMENT_PATTERNS; cols++)
+            weights[ALIGNMENT_WEIGHTS + rows * ALIGNMENT_PATTERNS + cols] =
+                16 * (2*MUSKETEERS - rows / N - cols / N);
+    for(moves = 0; moves <= 4*MUSKETEERS; moves++)
+        weights[MUSKETEER_MOVE_WEIGHTS + moves] = 4 * moves;
+    for(moves = 0; moves <= 4*N*N; moves++)
+        weights[SOLDIER_MOVE_WEIGHTS + moves] = -moves;
+}
 
-    else if(direction == 'd' || direction == 'D')
-        destinationBlock = board[(int)(row+1)][(int)(col-'1')];
-    
-    // While current block or destination block don't meet the checks, input has to be given again.
-    while(!checkCurrentBlock(player, currentBlock) || !checkDestinationBlock(player, destinationBlock)){       
+bool loadWeights(const char *fileName){
+    char magic[8];
+    uint32_t boardSize, count;
+    FILE *fp;
 
-        if(!readInputMove(input, player))                          // Read input and if player wants to exit the game return false, to exit the program in main.
-            return false;
+    if((fp = fopen(fileName, "rb")) == NULL){
+        printf("Error opening file\n");
+        return false;
+    }
+    if(fread(magic, sizeof(magic), 1, fp) != 1 || fread(&boardSize, sizeof(boardSize), 1, fp) != 1
+       || fread(&count, sizeof(count), 1, fp) != 1 || memcmp(magic, WEIGHTS_MAGIC, sizeof(magic)) != 0
+       || boardSize != N || count != PATTERN_WEIGHTS){
+        printf("%s is not a weights file for this board size\n", fileName);
+        fclose(fp);
+        return false;
+    }
+    if((patternWeights = malloc(PATTERN_WEIGHTS * sizeof(int16_t))) == NULL
+       || fread(patternWeights, sizeof(int16_t), PATTERN_WEIGHTS, fp) != PATTERN_WEIGHTS){
+        printf("Error reading %s\n", fileName);
+        free(patternWeights);
+        patternWeights = NULL;
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
 
-                row = input[0];
-                col = input[2];
-                direction = input [4];  
-                
-                while(!checkBoardLimit(row, col, direction)){      // While new move is not inside the board limit, read again.
-                    if(!readInputMove(input, player))
-                        return false;
+bool writeWeights(const char *fileName, const int16_t *weights){
+    uint32_t boardSize = N, count = PATTERN_WEIGHTS;
+    FILE *fp;
+    bool ok;
 
-                    row = input[0];
-                    col = input[2];
-                    direction = input [4];
-                }
-                row = convertRowInput(row);                                  // Convert characters to integer to control the board.
+    if((fp = fopen(fileName, "wb")) == NULL)
+        return false;
+    ok = fwrite(WEIGHTS_MAGIC, 8, 1, fp) == 1 && fwrite(&boardSize, sizeof(boardSize), 1, fp) == 1
+         && fwrite(&count, sizeof(count), 1, fp) == 1
+         && fwrite(weights, sizeof(int16_t), PATTERN_WEIGHTS, fp) == PATTERN_WEIGHTS;
+    return fclose(fp) == 0 && ok;
+}
 
-                currentBlock = board[(int)row][(int)(col-'1')];              // Declaring current block character.
+void *tuneThread(void *arg){
+    TuneWorker *worker = arg;
+    const TuneSample *sample;
+    double score, chance;
+    size_t k;
+    int i;
 
-                if(direction == 'r' || direction == 'R')                     // Depending on the direction, the function declares the direction block character.
-                    destinationBlock = board[(int)row][(int)(col-'1'+1)];
-                    
-                else if(direction == 'l' || direction == 'L')
-                    destinationBlock = board[(int)row][(int)(col-'1'-1)];
-                    
-                else if(direction == 'u' || direction == 'U')
-                    destinationBlock = board[(int)(row-1)][(int)(col-'1')];
-                    
-                else if(direction == 'd' || direction == 'D')
-                    destinationBlock = board[(int)(row+1)][(int)(col-'1')];
-    }
-
-    // Depending on the player and the direction that is given, changes will be made to the board.
-    if(player == 'M'){                                                         
-                                                                               
-        if(direction == 'r' || direction == 'R'){
-            board[row][col-'1'] = '.';
-            board[row][col-'1'+1] = 'M';
-            displayBoard(board);
-        }
-        else if(direction == 'l' || direction == 'L'){
-            board[row][col-'1'] = '.';
-            board[row][col-'1'-1] = 'M';
-            displayBoard(board);
-            }
-        else if(direction == 'u' || direction == 'U'){
-            board[row][col-'1'] = '.';
-            board[row-1][col-'1'] = 'M';
-            displayBoard(board);
-            }
-        else if(direction == 'd' || direction == 'D'){
-            board[row][col-'1'] = '.';
-            board[row+1][col-'1'] = 'M';
-            displayBoard(board);                
-            } 
-    }
-    else if(player == 'o'){
-        if(direction == 'r' || direction == 'R'){
-            board[row][col-'1'] = '.';
-            board[row][col-'1'+1] = 'o';
-            displayBoard(board);
-        }
-        else if(direction == 'l' || direction == 'L'){
-            board[row][col-'1'] = '.';
-            board[row][col-'1'-1] = 'o';
-            displayBoard(board);
-            }
-        else if(direction == 'u' || direction == 'U'){
-            board[row][col-'1'] = '.';
-            board[row-1][col-'1'] = 'o';
-            displayBoard(board);
-            }
-        else if(direction == 'd' || direction == 'D'){
-            board[row][col-'1'] = '.';
-            board[row+1][col-'1'] = 'o';
-            displayBoard(board);                
-            } 
+    worker->loss = 0;
+    memset(worker->gradient, 0, PATTERN_WEIGHTS * sizeof(double));
+    for(k = 0; k < worker->count; k++){
+        sample = &worker->samples[k];
+        for(score = 0, i = 0; i < PATTERN_FEATURES; i++)
+            score += worker->weights[sample->features[i]];
+        chance = 1.0 / (1.0 + exp(-TUNE_SCALE * score));
+        worker->loss -= sample->result > 0.5 ? log(chance + 1e-12) : log(1.0 - chance + 1e-12);
+        for(i = 0; i < PATTERN_FEATURES; i++)                     // d loss / d score = (chance - result) * TUNE_SCALE
+            worker->gradient[sample->features[i]] += (chance - sample->result) * TUNE_SCALE;
     }
-    return true;    // Return true if player does not want to exit the game.
-}
-
-bool checkForWinner(char board[N][N]){
-    bool musketeersWin = false, soldiersWin = false;
-    
-    int i, j;
-    int muskCollumnCount = 0, muskRowCount = 0, winningMusketeersCount = 0;
-    
-    for(i = 0; i < N; i++){
-            muskRowCount = 0;
-            for(j = 0; j < N; j++){
-                if(board[i][j] == 'M')
-                    muskRowCount++;
-            }
-            if(muskRowCount == 3){                              // If three musketeers are found on the same row
-                    printf("Cardinal Richelieu's men win!\n");  // Print winning message.
-                    soldiersWin = true;                         
-            }
-        }
-        for(j = 0; j < N; j++){                                 
-            muskCollumnCount = 0;                               
-            for(i = 0; i < N; i++){
-                if(board[i][j] == 'M')
-                    muskCollumnCount++;
-            }
-            if(muskCollumnCount == 3){                          // If three musketeers are found on the same collumn
-                    printf("Cardinal Richelieu's men win!\n");  // Print winning message.
-                    soldiersWin = true;
-            }
-        }
-        winningMusketeersCount = 0;
-        for(i = 0; i < N; i++)
-            for(j = 0; j < N; j++){
-                if(board[i][j] == 'M'){
-
-                    // Depending on the place of Musketeers on the board, check if they 
-                    // have no more soldiers around them to move, to decide if Musketeers won.
-                    
-                    if(i > 0 && i < 4 && j > 0 && j < 4){
-                        if(board[i-1][j] != 'o' && board[i+1][j] != 'o' && board[i][j-1] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 0 && j > 0 && j < 4){
-                        if(board[i+1][j] != 'o' && board[i][j-1] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 4 && j > 0 && j < 4){
-                        if(board[i-1][j] != 'o' && board[i][j-1] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i > 0 && i < 4 && j == 0){
-                        if(board[i-1][j] != 'o' && board[i+1][j] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i > 0 && i < 4 && j == 4){
-                        if(board[i-1][j] != 'o' && board[i+1][j] != 'o' && board[i][j-1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 0 & j == 0){
-                        if(board[i+1][j] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 0 & j == 4){
-                        if(board[i+1][j] != 'o' && board[i][j-1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 4 & j == 0){
-                        if(board[i-1][j] != 'o' && board[i][j+1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(i == 4 & j == 4){
-                        if(board[i-1][j] != 'o' && board[i][j-1] != 'o')
-                            winningMusketeersCount++;
-                    }
-                    if(winningMusketeersCount == 3){                       // If all 3 musketeers cannot move, 
-                        printf("The Musketeers win!");                     // Print winning message of masketeers.
-                        musketeersWin = true;
-                    }
-                }
-            }
-            if(soldiersWin == true || musketeersWin == true)               // If a winner is found return true.
-                return true;
-            else return false;
+    return NULL;
 }
 
-void play(char board[N][N]){
-    int n = 0;                                               // n is used to determine which player is playing
+bool tuneWeights(const Options *options){
+    const uint8_t *data, *end, *p;
+    TuneSample *samples = NULL, *grown;
+    TuneWorker *workers;
+    pthread_t *threads;
+    Position pos;
+    struct stat info;
+    int16_t *weights;
+    float *current;
+    double *gradients, *moment, *velocity, loss = 0, firstLoss = 0, gradient, step;
+    size_t count = 0, capacity = 0, share;
+    long games = 0, used = 0;
+    int fd, i, t, epoch, started, moves;
     char player;
-    bool endOfGame = false;
-    
-    while(!endOfGame){
-        
-        if(n % 2 == 0)                                       // If n is even, Musketeer plays else the enemy
-            player = 'M';
-        else player = 'o';
-            
-        char str[6];
-
-        if(!readInputMove(str, player))                      // If player wants to exit return
-            return;
+    bool ok = true;
+    double startTime = currentTime();
 
-        if(!moveBoard(str, board, player))
-            return;
+    if((fd = open(options->tuneGamesFile, O_RDONLY)) < 0 || fstat(fd, &info) != 0 || info.st_size == 0){
+        printf("Error opening file\n");
+        if(fd >= 0)
+            close(fd);
+        return false;
+    }
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        printf("Error mapping file\n");
+        return false;
+    }
+    end = data + info.st_size;
 
-        if(checkForWinner(board) ==true)                     // If winner is found, end the game loop
-            endOfGame=true;
-         n++;
+    // Every position of every finished game, in all symmetries, with the result of the game.
+    for(p = data; ok && end - p >= RECORD_HEADER_SIZE && memcmp(p, RECORD_MAGIC, 4) == 0
+                     && p[4] == RECORD_VERSION && p[5] == N; p += RECORD_HEADER_SIZE + moves, games++){
+        moves = p[24] | p[25] << 8;
+        if(end - p - RECORD_HEADER_SIZE < moves)
+            break;
+        if(p[6] == NO_WINNER || !decodeRecordStart(p, &pos))    // A game that was left has no result.
+            continue;
+        used++;
+        for(i = 0, player = 'M'; i <= moves && getWinner(&pos) == NO_WINNER; i++, player = player == 'M' ? 'o' : 'M'){
+            if(count + SYMMETRIES > capacity){
+                capacity = capacity ? 2*capacity : 65536;
+                if((grown = realloc(samples, capacity * sizeof(TuneSample))) == NULL){
+                    ok = false;
+                    break;
+                }
+                samples = grown;
+            }
+            for(t = 0; t < SYMMETRIES; t++, count++){
+                patternFeatures(transformBoard(pos.musketeers, t), transformBoard(pos.soldiers, t), samples[count].features);
+                samples[count].result = p[6] == MUSKETEERS_WIN;
+            }
+            if(i == moves || validateMove(&pos, player, p[RECORD_HEADER_SIZE + i]) != MOVE_OK)
+                break;
+            makeMove(&pos, player, p[RECORD_HEADER_SIZE + i]);
         }
-}
+    }
+    munmap((void *)data, info.st_size);
+    if(ok && count == 0){
+        printf("No finished games in %s\n", options->tuneGamesFile);
+        ok = false;
+    }
 
-bool writeBoard(char board[N][N], char **argv){
-    FILE *fpout = NULL;                                           // File pointer for output file.
-    int i, j;                                                     // Loop counters.
-    char str[100] = "out-";                                       // Initial part of output file.
-    char str1[50];                                                
-    strcpy(str1, argv[1]);                                        // Copy the second command line arguement to str1
+    weights = malloc(PATTERN_WEIGHTS * sizeof(int16_t));
+    current = malloc(PATTERN_WEIGHTS * sizeof(float));
+    gradients = calloc((size_t)options->threads * PATTERN_WEIGHTS, sizeof(double));
+    moment = calloc(PATTERN_WEIGHTS, sizeof(double));
+    velocity = calloc(PATTERN_WEIGHTS, sizeof(double));
+    workers = calloc(options->threads, sizeof(TuneWorker));
+    threads = calloc(options->threads, sizeof(pthread_t));
+    if(ok && (weights == NULL || current == NULL || gradients == NULL || moment == NULL || velocity == NULL
+              || workers == NULL || threads == NULL)){
+        printf("Not enough memory for the tuner\n");
+        ok = false;
+    }
 
-    strncat(str, argv[1], sizeof(str) - strlen(argv[1]) - 1);     // Concatenate str and str1
+    if(ok){
+        if(patternWeights != NULL)
+            memcpy(weights, patternWeights, PATTERN_WEIGHTS * sizeof(int16_t));
+        else defaultPatternWeights(weights);
+        for(i = 0; i < PATTERN_WEIGHTS; i++)
+            current[i] = weights[i];
+        printf("Tuning %d weights on %zu positions of %ld games\n", PATTERN_WEIGHTS, count, used);
 
-    if((fpout = fopen(str, "w")) == NULL){                        // If file open fails,
-        printf("Error opening file\n");                           // Print eror message and return false.
-        return false;                                               
-    }
-    fprintf(fpout, "    1   2   3   4   5  \n");
-    
-    for(i = 0; i < N; i++){
-        fprintf(fpout, "  +---+---+---+---+---+\n%c |", 'A'+i);
-        for(j = 0; j < N; j++){
-            fprintf(fpout, " %c |",board[i][j]);
+        share = (count + options->threads - 1) / options->threads;
+        for(t = 0; t < options->threads; t++){
+            workers[t].samples = samples + (t * share < count ? t * share : count);
+            workers[t].count = t * share >= count ? 0 : count - t * share < share ? count - t * share : share;
+            workers[t].weights = current;
+            workers[t].gradient = gradients + (size_t)t * PATTERN_WEIGHTS;
+        }
+        for(epoch = 1; ok && epoch <= options->tuneEpochs + 1; epoch++){
+            if(epoch > options->tuneEpochs)                       // The last pass only measures the rounded weights
+                for(i = 0; i < PATTERN_WEIGHTS; i++)              // that are written.
+                    current[i] = weights[i] = (int16_t)lrintf(current[i]);
+            for(started = 0; started < options->threads; started++)   // Every thread adds up its share.
+                if(pthread_create(&threads[started], NULL, tuneThread, &workers[started]) != 0)
+                    break;
+            for(t = 0; t < started; t++)
+                pthread_join(threads[t], NULL);
+            if(started < options->threads){
+                printf("Could not start the tuner threads\n");
+                ok = false;
+                break;
+            }
+            for(loss = 0, t = 0; t < options->threads; t++)
+                loss += workers[t].loss;
+            loss /= count;
+            if(epoch == 1)
+                firstLoss = loss;
+            if(epoch > options->tuneEpochs)
+                break;
+            for(i = 0; i < PATTERN_WEIGHTS; i++){                 // Adam with the mean gradient.
+                for(gradient = 0, t = 0; t < options->threads; t++)
+                    gradient += gradients[(size_t)t * PATTERN_WEIGHTS + i];
+                gradient /= count;
+                moment[i] = 0.9 * moment[i] + 0.1 * gradient;
+                velocity[i] = 0.999 * velocity[i] + 0.001 * gradient * gradient;
+                step = TUNE_RATE * (moment[i] / (1 - pow(0.9, epoch)))
+                       / (sqrt(velocity[i] / (1 - pow(0.999, epoch))) + 1e-12);
+                current[i] = fmaxf(-WEIGHT_LIMIT, fminf(WEIGHT_LIMIT, current[i] - step));
+            }
+            if(epoch % 50 == 0 || epoch == options->tuneEpochs){
+                printf("Epoch %d: loss %.5f (%.1f s)\n", epoch, loss, (currentTime() - startTime) / 1000.0);
+                fflush(stdout);
+            }
         }
-        fprintf(fpout, "\n");
     }
 
-    fprintf(fpout, "  +---+---+---+---+---+\n");
-
-    fclose(fpout);                                               // Close the output file
-    printf("Saving %s...Done\nAu Revoir!\n", str);               // Print success message with filename
-    
-    return true;
+    if(ok){
+        if(!writeWeights(options->tuneFile, weights)){
+            printf("Error writing %s\n", options->tuneFile);
+            ok = false;
+        }
+        else printf("Loss %.5f before, %.5f after, weights written to %s\n", firstLoss, loss, options->tuneFile);
+    }
+    free(samples);
+    free(weights);
+    free(current);
+    free(gradients);
+    free(moment);
+    free(velocity);
+    free(workers);
+    free(threads);
+    return ok;
 }
-
-